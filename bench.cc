@@ -0,0 +1,341 @@
+// Timings for the hot paths of the solver, for comparing table formats and
+// kernels, with cache miss rates where the CPU's counters are available.
+// Usage: bench [iterations]
+// $WORDLE_STATE_KERNELS selects the State kernels to time; see state_kernels.h.
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "absl/numeric/bits.h"
+#include "absl/strings/numbers.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "color_guess.h"
+#include "partition_map.h"
+#include "raw_data.h"
+#include "state.h"
+
+using namespace wordle;
+
+// Every heap allocation in the program, so the benchmarks can report them.
+std::atomic<int64_t> num_allocations{0};
+
+void* operator new(size_t size) {
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+namespace {
+
+// Returns the branch of `in` reached by guessing `guess` and seeing `colors`.
+State Follow(const State& in, const char* guess, const char* colors) {
+  Word w(guess);
+  for (FullPartition& p : SubPartitions(in)) {
+    if (p.word == w) {
+      for (FullBranch& b : p.branches) {
+        if (b.colors == Colors(colors)) {
+          return std::move(b.mask);
+        }
+      }
+    }
+  }
+  return State::MakeEmpty();
+}
+
+void ReportTableSizes() {
+  size_t plain = 0;
+  size_t compact = 0;
+  for (int f = 0; f < raw::num_factors; ++f) {
+    plain += raw::factor_masks[f].size() * sizeof(raw::Mask);
+    compact += (raw::compact_factor_masks[f].headers.size() +
+                raw::compact_factor_masks[f].words.size()) *
+               sizeof(uint64_t);
+  }
+  size_t branches = 0;
+  for (const raw::Guess& guess : raw::guesses) {
+    branches += guess.branches.size();
+  }
+  printf("%d factors; mask tables: plain %.2f MB, compact %.2f MB; "
+         "branches %.2f MB\n",
+         raw::num_factors, plain / 1e6, compact / 1e6,
+         branches * sizeof(raw::Indices) / 1e6);
+}
+
+// Reports how many of the 64-bit words of the masks are nonzero: for each
+// factor table, and for the branches, both the words present in every factor
+// (which the compact kernel reads) and those of the final mask.
+void ReportWordCounts() {
+  for (int f = 0; f < raw::num_factors; ++f) {
+    printf("factor %d: %.2f nonzero words per mask\n", f,
+           double(raw::compact_factor_masks[f].words.size()) /
+               raw::compact_factor_masks[f].headers.size());
+  }
+  int64_t branches = 0;
+  int64_t present_words = 0;
+  int64_t nonzero_words = 0;
+  for (const raw::Guess& guess : raw::guesses) {
+    for (const raw::Indices& branch : guess.branches) {
+      uint64_t present = raw::kCompactPresentMask;
+      raw::Mask mask = State::AllBits().array();
+      for (int f = 0; f < raw::num_factors; ++f) {
+        present &= branch.CompactFactorMask(f).present;
+        for (int i = 0; i < State::kNumWords; ++i) {
+          mask[i] &= branch.FactorMask(f)[i];
+        }
+      }
+      for (uint64_t word : mask) {
+        nonzero_words += word != 0;
+      }
+      present_words += absl::popcount(present);
+      ++branches;
+    }
+  }
+  printf("branches: %.2f words present in all factors, %.2f nonzero\n",
+         double(present_words) / branches, double(nonzero_words) / branches);
+}
+
+// Hardware cache counters for the calling thread, where the kernel exposes
+// them.  L1D read misses go to L2; last-level cache reads are L2 misses, and
+// last-level misses go to memory.
+class CacheCounters {
+ public:
+  CacheCounters() {
+    const uint64_t kRead = PERF_COUNT_HW_CACHE_OP_READ << 8;
+    const uint64_t kAccess = PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16;
+    const uint64_t kMiss = PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+    const uint64_t configs[kNumCounters] = {
+        PERF_COUNT_HW_CACHE_L1D | kRead | kMiss,
+        PERF_COUNT_HW_CACHE_LL | kRead | kAccess,
+        PERF_COUNT_HW_CACHE_LL | kRead | kMiss,
+    };
+    for (int i = 0; i < kNumCounters; ++i) {
+      perf_event_attr attr = {};
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = configs[i];
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fds_[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+  }
+  ~CacheCounters() {
+    for (int fd : fds_) {
+      if (fd >= 0) close(fd);
+    }
+  }
+
+  bool available() const {
+    return std::all_of(fds_.begin(), fds_.end(),
+                       [](int fd) { return fd >= 0; });
+  }
+
+  void Start() {
+    for (int fd : fds_) {
+      ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  // Stops counting and prints the rates since Start().
+  void Report() {
+    std::array<uint64_t, kNumCounters> counts = {};
+    for (int i = 0; i < kNumCounters; ++i) {
+      ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fds_[i], &counts[i], sizeof(counts[i])) != sizeof(counts[i])) {
+        counts[i] = 0;
+      }
+    }
+    printf("  L1D misses %.1fM, L2 miss rate %.1f%%, L3 miss rate %.1f%%\n",
+           counts[0] / 1e6,
+           100.0 * counts[1] / std::max<uint64_t>(counts[0], 1),
+           100.0 * counts[2] / std::max<uint64_t>(counts[1], 1));
+  }
+
+ private:
+  static constexpr int kNumCounters = 3;
+  std::array<int, kNumCounters> fds_;
+};
+
+// Times building every branch of every guess from `in`, without the sorting
+// and deduplication SubPartitions does.  `count_branch` returns the number of
+// targets in a branch.
+template <typename Fn>
+void TimeBranchKernel(const char* name, int iterations, Fn count_branch) {
+  int64_t branches = 0;
+  int64_t bits = 0;
+  absl::Time start = absl::Now();
+  for (int it = 0; it < iterations; ++it) {
+    for (const raw::Guess& guess : raw::guesses) {
+      for (const raw::Indices& branch : guess.branches) {
+        bits += count_branch(branch);
+        ++branches;
+      }
+    }
+  }
+  absl::Duration elapsed = absl::Now() - start;
+  printf("  %-8s %7.2f ns/branch  (%lld bits)\n", name,
+         absl::ToDoubleNanoseconds(elapsed) / branches,
+         static_cast<long long>(bits / iterations));
+}
+
+// Counts the targets of `in` in a branch through the compact tables, without
+// building a State.  This is mostly table reads.
+int CountBranch(const State& in, const raw::Indices& b) {
+  CompactMask masks[raw::kMaxFactors] = {};
+  b.CompactFactorMasks(masks);
+  uint64_t present = masks[0].present;
+  for (int f = 1; f < raw::num_factors; ++f) {
+    present &= masks[f].present;
+  }
+  int count = 0;
+  while (present) {
+    const int i = absl::countr_zero(present);
+    const uint64_t below = (uint64_t{1} << i) - 1;
+    present &= present - 1;
+    uint64_t word = in.array()[i];
+    for (int f = 0; f < raw::num_factors; ++f) {
+      word &= masks[f].words[absl::popcount(masks[f].present & below)];
+    }
+    count += absl::popcount(word);
+  }
+  return count;
+}
+
+void TimeSubPartitions(const char* name, const State& in, int iterations,
+                       CacheCounters& counters) {
+  size_t partitions = 0;
+  const int64_t allocations = num_allocations.load();
+  counters.Start();
+  absl::Time start = absl::Now();
+  for (int it = 0; it < iterations; ++it) {
+    partitions = SubPartitions(in).size();
+  }
+  absl::Duration elapsed = absl::Now() - start;
+  printf("SubPartitions(%s): %d bits, %zu partitions, %.1f ms, "
+         "%lld allocations\n",
+         name, in.count(), partitions,
+         absl::ToDoubleMilliseconds(elapsed) / iterations,
+         static_cast<long long>((num_allocations.load() - allocations) /
+                                iterations));
+  if (counters.available()) {
+    counters.Report();
+  }
+
+  // Again into a PartitionList that has already grown to fit, as in a
+  // search.
+  PartitionList list;
+  SubPartitions(in, &list);
+  const int64_t list_allocations = num_allocations.load();
+  start = absl::Now();
+  for (int it = 0; it < iterations; ++it) {
+    SubPartitions(in, &list);
+  }
+  elapsed = absl::Now() - start;
+  printf("  into a PartitionList: %.1f ms, %lld allocations, "
+         "%d distinct states\n",
+         absl::ToDoubleMilliseconds(elapsed) / iterations,
+         static_cast<long long>((num_allocations.load() - list_allocations) /
+                                iterations),
+         list.num_states());
+
+  // Starting a best-first stream, and building its first few partitions, as
+  // a scorer that is soon cut off does.
+  PartitionStream stream;
+  PartitionStream::Entry entry;
+  start = absl::Now();
+  for (int it = 0; it < iterations; ++it) {
+    StreamPartitions(in, &stream);
+  }
+  const absl::Duration started = absl::Now() - start;
+  start = absl::Now();
+  for (int i = 0; i < 10 && stream.Next(&entry); ++i) {
+  }
+  elapsed = absl::Now() - start;
+  printf("  streamed: %.1f ms to start, %.2f ms for the first 10 of %d\n",
+         absl::ToDoubleMilliseconds(started) / iterations,
+         absl::ToDoubleMilliseconds(elapsed), stream.num_candidates());
+}
+
+// Times SubPartitions into a PartitionList with `in` in sparse and in dense
+// form, whichever sparse_partition_cutoff would pick.
+void TimeSparseAndDense(const State& in, int iterations) {
+  const int cutoff = sparse_partition_cutoff;
+  double ms[2];
+  PartitionList list;
+  for (int sparse = 0; sparse < 2; ++sparse) {
+    sparse_partition_cutoff = sparse ? kNumTargets : 0;
+    SubPartitions(in, &list);
+    absl::Time start = absl::Now();
+    for (int it = 0; it < iterations; ++it) {
+      SubPartitions(in, &list);
+    }
+    ms[sparse] = absl::ToDoubleMilliseconds(absl::Now() - start) / iterations;
+  }
+  sparse_partition_cutoff = cutoff;
+  printf("  dense %.1f ms, sparse %.1f ms (sparse up to %d bits)\n", ms[0],
+         ms[1], cutoff);
+}
+
+void Bench(const char* name, const State& in, int iterations,
+           CacheCounters& counters) {
+  TimeSubPartitions(name, in, iterations, counters);
+  TimeSparseAndDense(in, iterations);
+  TimeBranchKernel("plain", iterations, [&](const raw::Indices& b) {
+    const raw::Mask* masks[raw::kMaxFactors];
+    b.FactorMasks(masks);
+    return State(in, masks, raw::num_factors).count();
+  });
+  TimeBranchKernel("compact", iterations, [&](const raw::Indices& b) {
+    CompactMask masks[raw::kMaxFactors];
+    b.CompactFactorMasks(masks);
+    return State(in, masks, raw::num_factors).count();
+  });
+  // As SubPartitions does, skipping the words that are zero in `in`.
+  const uint64_t in_nonzero = in.NonzeroWords();
+  TimeBranchKernel("nonzero", iterations, [&](const raw::Indices& b) {
+    CompactMask masks[raw::kMaxFactors];
+    b.CompactFactorMasks(masks);
+    return State(in, masks, raw::num_factors, in_nonzero).count();
+  });
+  TimeBranchKernel("count", iterations,
+                   [&](const raw::Indices& b) { return CountBranch(in, b); });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int iterations = 3;
+  if (argc > 2 || (argc == 2 && !absl::SimpleAtoi(argv[1], &iterations))) {
+    fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+  printf("state kernels: %s\n", state_kernels->name);
+  ReportTableSizes();
+  ReportWordCounts();
+  CacheCounters counters;
+  if (!counters.available()) {
+    printf("hardware cache counters unavailable\n");
+  }
+  const State& all = State::AllBits();
+  State fuzzy = Follow(all, "fuzzy", "00000");
+  State raise = Follow(all, "raise", "00000");
+  Bench("AllBits", all, iterations, counters);
+  Bench("fuzzy/00000", fuzzy, iterations, counters);
+  Bench("raise/00000", raise, iterations, counters);
+}
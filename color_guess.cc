@@ -1,9 +1,164 @@
 #include "color_guess.h"
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <string_view>
 
 namespace wordle {
 
+namespace {
+
+// Layout of the file written by ColorTable::Write().  The header is padded to
+// 64 bytes and is followed by the codes, one row of kNumTargets per guess.
+struct ColorTableHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_guesses;
+  uint32_t num_targets;
+  uint32_t reserved;
+  // DictionaryHash() of the dictionary the codes were computed from.
+  uint64_t dictionary_hash;
+  char padding[32];
+};
+static_assert(sizeof(ColorTableHeader) == 64);
+
+constexpr char kColorTableMagic[8] = {'W', 'R', 'D', 'L', 'C', 'O', 'L', 'R'};
+
+constexpr size_t kColorTableSize = size_t{kDictionarySize} * kNumTargets;
+
+// Returns a hash of every word of the dictionary in index order, which is
+// stable across builds and runs.  Tables from a dictionary with the same
+// sizes but different words are rejected by comparing this.
+uint64_t DictionaryHash() {
+  // 64-bit FNV-1a over the packed words.
+  uint64_t hash = 0xcbf29ce484222325;
+  for (PackedWord word : Word::AllPackedWords()) {
+    for (int i = 0; i < 8; ++i) {
+      hash ^= (word.bits() >> (8 * i)) & 0xff;
+      hash *= 0x100000001b3;
+    }
+  }
+  return hash;
+}
+
+// Same algorithm as ColorGuess(), but on packed letters and producing a code.
+uint8_t ColorCode(PackedWord guess, PackedWord target) {
+  int colors[5] = {0, 0, 0, 0, 0};
+  int available[5];
+  for (int i = 0; i < 5; ++i) {
+    available[i] = target.Letter(i);
+    if (guess.Letter(i) != 0 && guess.Letter(i) == available[i]) {
+      colors[i] = 2;
+      available[i] = 0;
+    }
+  }
+  for (int i = 0; i < 5; ++i) {
+    int letter = guess.Letter(i);
+    if (colors[i] == 2 || letter == 0) continue;
+    for (int j = 0; j < 5; ++j) {
+      if (available[j] == letter) {
+        available[j] = 0;
+        colors[i] = 1;
+        break;
+      }
+    }
+  }
+  int code = 0;
+  for (int i = 4; i >= 0; --i) {
+    code = code * 3 + colors[i];
+  }
+  return code;
+}
+
+#if defined(__x86_64__)
+
+// Compiled for AVX2 whatever the build flags, and only called after checking
+// the CPU, as in state_kernels.cc.
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+// Colors `guess` against four targets at once, one target per 64-bit lane.
+// Each lane works on byte masks (0x00 or 0xff per letter position).
+AVX2_TARGET inline void ColorGuessX4(PackedWord guess, const PackedWord* targets,
+                         uint8_t* codes) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i letters = _mm256_set1_epi64x(0xffffffffff);
+  const __m256i g = _mm256_set1_epi64x(guess.bits());
+  const __m256i t =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(targets));
+
+  const __m256i green = _mm256_andnot_si256(
+      _mm256_cmpeq_epi8(g, zero),
+      _mm256_and_si256(_mm256_cmpeq_epi8(t, g), letters));
+  __m256i available = _mm256_andnot_si256(green, letters);
+  __m256i yellow = zero;
+  for (int i = 0; i < 5; ++i) {
+    const int letter = guess.Letter(i);
+    if (letter == 0) continue;
+    // Spread byte `i` of each lane's green mask across the whole lane.
+    const __m256i spread = _mm256_set_epi64x(
+        0x0808080808080808 + 0x0101010101010101 * i, 0x0101010101010101 * i,
+        0x0808080808080808 + 0x0101010101010101 * i, 0x0101010101010101 * i);
+    const __m256i green_i = _mm256_shuffle_epi8(green, spread);
+    const __m256i match = _mm256_andnot_si256(
+        green_i,
+        _mm256_and_si256(_mm256_cmpeq_epi8(t, _mm256_set1_epi8(letter)),
+                         available));
+    // Isolate the lowest matching byte: x & -x leaves its low bit, and
+    // (bit << 8) - bit widens that to the full byte.
+    const __m256i low_bit =
+        _mm256_and_si256(match, _mm256_sub_epi64(zero, match));
+    const __m256i used =
+        _mm256_sub_epi64(_mm256_slli_epi64(low_bit, 8), low_bit);
+    available = _mm256_xor_si256(available, used);
+    yellow = _mm256_or_si256(
+        yellow, _mm256_andnot_si256(_mm256_cmpeq_epi64(used, zero),
+                                    _mm256_set1_epi64x(0xffull << (8 * i))));
+  }
+  // One base-3 digit per byte, then a weighted sum of the five digits.
+  const __m256i digits = _mm256_or_si256(
+      _mm256_and_si256(green, _mm256_set1_epi8(2)),
+      _mm256_and_si256(yellow, _mm256_set1_epi8(1)));
+  const __m256i weights = _mm256_set1_epi64x(0x000000511b090301);
+  __m256i sums = _mm256_maddubs_epi16(digits, weights);
+  sums = _mm256_madd_epi16(sums, _mm256_set1_epi16(1));
+  sums = _mm256_add_epi32(sums, _mm256_srli_epi64(sums, 32));
+  const __m128i packed = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(
+      sums, _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0)));
+  const __m128i bytes =
+      _mm_packus_epi16(_mm_packus_epi32(packed, packed), packed);
+  const int out = _mm_cvtsi128_si32(bytes);
+  memcpy(codes, &out, 4);
+}
+
+AVX2_TARGET void ColorGuessBatchAvx2(PackedWord guess,
+                                     const PackedWord* targets, int n,
+                                     uint8_t* codes) {
+  int i = 0;
+  for (; i + 4 <= n; i += 4) {
+    ColorGuessX4(guess, targets + i, codes + i);
+  }
+  for (; i < n; ++i) {
+    codes[i] = ColorCode(guess, targets[i]);
+  }
+}
+
+bool HasAvx2() {
+  static const bool has_avx2 = [] {
+    __builtin_cpu_init();
+    return bool(__builtin_cpu_supports("avx2"));
+  }();
+  return has_avx2;
+}
+
+#endif  // defined(__x86_64__)
+
+}  // namespace
+
 Colors::Colors(std::string_view s) : value_(0) {
   for (size_t i = 0; i < 5; ++i) {
     if (s.size() <= i) return;
@@ -38,4 +193,81 @@ Colors ColorGuess(const char* guess, const char* target) {
   return ans;
 }
 
+void ColorGuessBatch(PackedWord guess, const PackedWord* targets, int n,
+                     uint8_t* codes) {
+#if defined(__x86_64__)
+  if (HasAvx2()) {
+    ColorGuessBatchAvx2(guess, targets, n, codes);
+    return;
+  }
+#endif
+  for (int i = 0; i < n; ++i) {
+    codes[i] = ColorCode(guess, targets[i]);
+  }
+}
+
+std::unique_ptr<ColorTable> ColorTable::Build() {
+  std::unique_ptr<ColorTable> table(new ColorTable);
+  table->owned_.resize(kColorTableSize);
+  const std::vector<PackedWord>& packed = Word::AllPackedWords();
+  for (int i = 0; i < kDictionarySize; ++i) {
+    ColorGuessBatch(packed[i], packed.data(), kNumTargets,
+                    table->owned_.data() + size_t{kNumTargets} * i);
+  }
+  table->codes_ = table->owned_.data();
+  return table;
+}
+
+std::unique_ptr<ColorTable> ColorTable::Load(const std::string& path) {
+  std::unique_ptr<MappedFile> file = MappedFile::Open(path);
+  if (!file || file->size() != sizeof(ColorTableHeader) + kColorTableSize) {
+    return nullptr;
+  }
+  ColorTableHeader header;
+  memcpy(&header, file->data(), sizeof(header));
+  if (memcmp(header.magic, kColorTableMagic, sizeof(header.magic)) != 0 ||
+      header.version != kVersion || header.num_guesses != kDictionarySize ||
+      header.num_targets != kNumTargets ||
+      header.dictionary_hash != DictionaryHash()) {
+    return nullptr;
+  }
+  std::unique_ptr<ColorTable> table(new ColorTable);
+  table->codes_ =
+      reinterpret_cast<const uint8_t*>(file->data() + sizeof(header));
+  table->mapped_ = std::move(file);
+  return table;
+}
+
+bool ColorTable::Write(const std::string& path) const {
+  ColorTableHeader header = {};
+  memcpy(header.magic, kColorTableMagic, sizeof(header.magic));
+  header.version = kVersion;
+  header.num_guesses = kDictionarySize;
+  header.num_targets = kNumTargets;
+  header.dictionary_hash = DictionaryHash();
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(codes_, 1, kColorTableSize, f) == kColorTableSize;
+  return (fclose(f) == 0) && ok;
+}
+
+const ColorTable& ColorTable::Get() {
+  static const ColorTable* table = [] {
+    const char* path = getenv("WORDLE_COLOR_TABLE");
+    std::unique_ptr<ColorTable> loaded =
+        Load(path != nullptr ? path : "color_table.bin");
+    if (loaded) {
+      return loaded.release();
+    }
+    if (path != nullptr) {
+      fprintf(stderr, "Could not load color table %s; rebuilding\n", path);
+    }
+    return Build().release();
+  }();
+  return *table;
+}
+
 }  // namespace wordle
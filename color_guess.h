@@ -1,10 +1,14 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "dictionary.h"
+#include "mapped_file.h"
 
 namespace wordle {
 
@@ -20,6 +24,26 @@ class Colors {
 
   int ToInt() const { return value_; }
 
+  // Returns the compact base-3 code for these colors, in [0, kNumColorCodes).
+  // Position 0 is the least significant digit, so codes sort in the same
+  // order as Colors do.
+  constexpr int ToCode() const {
+    int code = 0;
+    for (int i = 4; i >= 0; --i) {
+      code = code * 3 + ((value_ >> (i * 2)) & 3);
+    }
+    return code;
+  }
+
+  static constexpr Colors FromCode(int code) {
+    uint16_t v = 0;
+    for (int i = 0; i < 5; ++i) {
+      v |= (code % 3) << (i * 2);
+      code /= 3;
+    }
+    return Colors(v);
+  }
+
   int Get(int i) const {
     int v = value_ >> (i * 2);
     return v % 4;
@@ -49,12 +73,69 @@ class Colors {
   uint16_t value_;
 };
 
+constexpr int kNumColorCodes = 243;
+
 // Return an object representing the color output of a given guess vs a given
-// target.  This is not fast, but it doesn't need to be.
+// target.  This is not fast; use ColorTable for bulk lookups.
 Colors ColorGuess(Word guess, Word target);
 
 // const char* version of the above.  Both arguments must be 5 characters long;
 // this is not checked.
 Colors ColorGuess(const char* guess, const char* target);
 
+// Colors `guess` against each of the `n` words at `targets`, writing one
+// Colors::ToCode() value per target to `codes`.  Wildcard letters in `guess`
+// are never colored, so partial guesses such as "*a*e*" are supported.  This
+// uses an AVX2 kernel when the CPU has AVX2, whatever the build flags, and a
+// scalar loop otherwise.
+void ColorGuessBatch(PackedWord guess, const PackedWord* targets, int n,
+                     uint8_t* codes);
+
+// A dense matrix of the colors of every guess vs every target word, stored as
+// one Colors::ToCode() byte per pair.  The table can be written to a binary
+// file and later memory-mapped, so that loading it costs nothing up front.
+class ColorTable {
+ public:
+  // Bumped whenever the on-disk layout changes.
+  static constexpr uint32_t kVersion = 2;
+
+  ColorTable(const ColorTable&) = delete;
+  ColorTable& operator=(const ColorTable&) = delete;
+
+  // Computes the table in memory.
+  static std::unique_ptr<ColorTable> Build();
+
+  // Maps a table previously written by Write().  Returns nullptr if the file
+  // is missing, or was written with a different version or dictionary.
+  static std::unique_ptr<ColorTable> Load(const std::string& path);
+
+  // Writes this table to `path`.  Returns false on failure.
+  bool Write(const std::string& path) const;
+
+  // Returns the process-wide table.  On first use this maps the file named
+  // by $WORDLE_COLOR_TABLE, defaulting to color_table.bin in the working
+  // directory, if it is valid, and otherwise builds the table in memory.
+  // Building takes about a second.
+  static const ColorTable& Get();
+
+  uint8_t Code(Word guess, Word target) const {
+    return codes_[guess.ToIndex() * kNumTargets + target.ToIndex()];
+  }
+  Colors Lookup(Word guess, Word target) const {
+    return Colors::FromCode(Code(guess, target));
+  }
+
+  // Returns the codes for `guess` against every target, in target order.
+  const uint8_t* Row(Word guess) const {
+    return codes_ + guess.ToIndex() * kNumTargets;
+  }
+
+ private:
+  ColorTable() = default;
+
+  const uint8_t* codes_ = nullptr;
+  std::vector<uint8_t> owned_;
+  std::unique_ptr<MappedFile> mapped_;
+};
+
 }  // namespace wordle
\ No newline at end of file
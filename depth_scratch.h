@@ -0,0 +1,28 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+namespace wordle {
+
+// Scratch objects for a recursive search, one per recursion depth.  Declare
+// one thread_local per search: each level's buffers then survive from one
+// call to the next, so once they have grown to fit, the recursion stops
+// allocating.  Levels keep their largest size for the life of the thread.
+template <typename T>
+class DepthScratch {
+ public:
+  // Returns the scratch for `depth`, creating it on first use.  References
+  // stay valid as deeper levels are added.
+  T& at(int depth) {
+    while (int(levels_.size()) <= depth) {
+      levels_.push_back(std::make_unique<T>());
+    }
+    return *levels_[depth];
+  }
+
+ private:
+  std::vector<std::unique_ptr<T>> levels_;
+};
+
+}  // namespace wordle
@@ -1635,6 +1635,14 @@ const char* non_targets[10638] = {
 
 }  // namespace
 
+PackedWord::PackedWord(std::string_view s) : bits_(0) {
+  for (size_t i = 0; i < 5 && i < s.size(); ++i) {
+    if (s[i] >= 'a' && s[i] <= 'z') {
+      bits_ |= uint64_t(s[i] - 'a' + 1) << (8 * i);
+    }
+  }
+}
+
 Word::Word(std::string_view s) {
   const char** it = std::lower_bound(std::begin(targets), std::end(targets), s,
                                      std::less<std::string_view>{});
@@ -1683,4 +1691,49 @@ const std::vector<Word>& Word::AllTargetWords() {
   return words;
 }
 
-}  // namespace wordle
\ No newline at end of file
+const std::vector<PackedWord>& Word::AllPackedWords() {
+  static auto words = [] {
+    std::vector<PackedWord> w;
+    for (Word word : AllWords()) {
+      w.emplace_back(word.ToString());
+    }
+    return w;
+  }();
+  return words;
+}
+
+namespace {
+
+struct TargetOrder {
+  uint16_t target_at_bit[kNumTargets];
+  uint16_t bit_of_target[kNumTargets];
+};
+
+constexpr TargetOrder IdentityOrder() {
+  TargetOrder order = {};
+  for (int i = 0; i < kNumTargets; ++i) {
+    order.target_at_bit[i] = i;
+    order.bit_of_target[i] = i;
+  }
+  return order;
+}
+
+// Constant-initialized, so it's valid before any dynamic initializer runs.
+TargetOrder target_order = IdentityOrder();
+
+}  // namespace
+
+Word TargetAtBit(int bit) { return Word(target_order.target_at_bit[bit]); }
+
+int BitOfTarget(Word target) {
+  return target_order.bit_of_target[target.ToIndex()];
+}
+
+void SetTargetOrder(const uint16_t* target_at_bit) {
+  for (int i = 0; i < kNumTargets; ++i) {
+    target_order.target_at_bit[i] = target_at_bit[i];
+    target_order.bit_of_target[target_at_bit[i]] = i;
+  }
+}
+
+}  // namespace wordle
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <string_view>
@@ -11,6 +12,25 @@ constexpr int kNumTargets = 2309;
 constexpr int kNumNonTargets = 10638;
 constexpr int kDictionarySize = kNumTargets + kNumNonTargets;
 
+// The five letters of a word packed into the low 40 bits of a uint64_t, one
+// byte per letter with 'a'..'z' stored as 1..26.  Position 0 is the low byte.
+// A zero byte is a wildcard, which never matches any letter.
+class PackedWord {
+ public:
+  constexpr PackedWord() : bits_(0) {}
+  explicit constexpr PackedWord(uint64_t bits) : bits_(bits) {}
+
+  // Packs the first five characters of `s`.  Characters outside a-z become
+  // wildcards.
+  explicit PackedWord(std::string_view s);
+
+  uint64_t bits() const { return bits_; }
+  int Letter(int i) const { return (bits_ >> (8 * i)) & 0xff; }
+
+ private:
+  uint64_t bits_;
+};
+
 class Word {
  public:
   Word() : index_(0xffff) {}
@@ -37,6 +57,12 @@ class Word {
   const char* ToString() const;
   int ToIndex() const { return index_; }
 
+  PackedWord Packed() const { return AllPackedWords()[index_]; }
+
+  // Returns the packed form of every word, indexed by ToIndex().  The first
+  // kNumTargets entries are the targets.
+  static const std::vector<PackedWord>& AllPackedWords();
+
   friend std::ostream& operator<<(std::ostream& os, const Word& w) {
     return os << w.ToString();
   }
@@ -59,4 +85,15 @@ class Word {
   uint16_t index_;
 };
 
-}  // namespace wordle
\ No newline at end of file
+// State bitmasks hold one bit per target.  By default bit i is target i, but
+// the raw tables may order targets differently for locality (see
+// `generate_tables --permute_targets`), installing the order before main()
+// starts.  Convert between bits and Words only through these.
+Word TargetAtBit(int bit);
+int BitOfTarget(Word target);
+
+// Makes bit i hold target `target_at_bit[i]`, which must be a permutation of
+// [0, kNumTargets).
+void SetTargetOrder(const uint16_t* target_at_bit);
+
+}  // namespace wordle
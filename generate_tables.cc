@@ -1,125 +1,828 @@
+#include <algorithm>
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <functional>
 #include <iostream>
-#include <set>
+#include <memory>
+#include <optional>
 #include <string>
+#include <thread>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/container/node_hash_set.h"
+#include "absl/hash/hash.h"
+#include "absl/memory/memory.h"
+#include "absl/numeric/bits.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "color_guess.h"
 #include "dictionary.h"
+#include "mapped_file.h"
+#include "raw_blob.h"
 #include "state.h"
+#include "thread_pool.h"
 
 using namespace wordle;
 
-class StateIndexer {
+using Mask = State::Array;
+
+// Deduplicates masks that are discovered concurrently.  The returned
+// pointers stay valid for the life of the set.
+class ConcurrentMaskSet {
  public:
-  StateIndexer() {
-    index_to_mask_.emplace_back(State::MakeEmpty());
-    index_to_mask_.emplace_back(State::MakeAllBits());
-    state_id_to_index_[index_to_mask_[0].ToStateId()] = 0;
-    state_id_to_index_[index_to_mask_[1].ToStateId()] = 1;
+  const Mask* Insert(const Mask& mask) {
+    const size_t hash = absl::HashOf(mask);
+    Shard& shard = shards_[hash % kNumShards];
+    absl::MutexLock lock(&shard.mu);
+    return &*shard.masks.insert(mask).first;
   }
 
-  int Index(const std::bitset<kNumTargets>& bitmask) {
-    State s(bitmask);
-    auto it = state_id_to_index_.find(s.ToStateId());
-    if (it != state_id_to_index_.end()) {
-      return it->second;
-    }
-    int new_index = index_to_mask_.size();
-    state_id_to_index_[s.ToStateId()] = new_index;
-    index_to_mask_.push_back(std::move(s));
-    return new_index;
+ private:
+  static constexpr int kNumShards = 64;
+
+  struct Shard {
+    absl::Mutex mu;
+    absl::node_hash_set<Mask> masks;
+  };
+  std::array<Shard, kNumShards> shards_;
+};
+
+// Assigns table indices to the masks of one factor in order of first use.
+// Index 0 is always the empty mask and index 1 is the full mask.  Masks are
+// usually looked up by address, since the same few pointers recur.
+class MaskNumbering {
+ public:
+  MaskNumbering() {
+    Mask empty;
+    empty.fill(0);
+    Intern(empty);
+    Intern(State::AllBits().array());
   }
 
-  const State& Lookup(int index) const { return index_to_mask_[index]; }
+  int Index(const Mask* mask) {
+    auto res = by_address_.try_emplace(mask, 0);
+    if (res.second) {
+      res.first->second = Intern(*mask);
+    }
+    return res.first->second;
+  }
 
-  int size() const { return index_to_mask_.size(); }
+  std::vector<Mask> TakeMasks() { return std::move(masks_); }
 
  private:
-  std::map<StateId, int> state_id_to_index_;
-  std::deque<State> index_to_mask_;
+  int Intern(const Mask& mask) {
+    auto res = by_value_.try_emplace(mask, masks_.size());
+    if (res.second) {
+      masks_.push_back(mask);
+    }
+    return res.first->second;
+  }
+
+  absl::flat_hash_map<const Mask*, int> by_address_;
+  absl::flat_hash_map<Mask, int> by_value_;
+  std::vector<Mask> masks_;
 };
 
-std::set<std::pair<int, int>> g_all_indices;
+// A partition of the alphabet into factor groups.  Bit `c - 'a'` of
+// letters[f] is set iff letter c belongs to group f.  Each branch mask is the
+// AND of the masks from guessing only the letters in each group, so every
+// group contributes one factor table.
+struct Grouping {
+  std::vector<uint32_t> letters;
+
+  int size() const { return letters.size(); }
+
+  // Returns the groups as comma-separated letters, in the form accepted by
+  // Parse().
+  std::string ToString() const {
+    std::string out;
+    for (uint32_t group : letters) {
+      if (!out.empty()) {
+        out += ',';
+      }
+      for (int c = 0; c < 26; ++c) {
+        if (group & (uint32_t{1} << c)) {
+          out += char('a' + c);
+        }
+      }
+    }
+    return out;
+  }
+
+  // Parses comma-separated groups of letters.  Letters that appear in no
+  // group form one more group at the end, so "aeiouys" is the default
+  // vowel/consonant split.  There must be between 2 and raw::kMaxFactors
+  // groups.
+  static bool Parse(absl::string_view spec, Grouping* out) {
+    out->letters.clear();
+    uint32_t used = 0;
+    for (absl::string_view part : absl::StrSplit(spec, ',')) {
+      uint32_t group = 0;
+      for (char c : part) {
+        if (c < 'a' || c > 'z') return false;
+        const uint32_t bit = uint32_t{1} << (c - 'a');
+        if ((used | group) & bit) return false;
+        group |= bit;
+      }
+      if (group == 0) return false;
+      used |= group;
+      out->letters.push_back(group);
+    }
+    if (used != kAllLetters) {
+      out->letters.push_back(kAllLetters & ~used);
+    }
+    return out->size() >= 2 && out->size() <= raw::kMaxFactors;
+  }
+
+  static constexpr uint32_t kAllLetters = (uint32_t{1} << 26) - 1;
+};
+
+Grouping DefaultGrouping() {
+  Grouping grouping;
+  Grouping::Parse("aeiouys", &grouping);
+  return grouping;
+}
+
+// Orders the targets in [begin, end) by splitting them on the letter that
+// divides them most evenly, those without it first, and recursing.
+// `letters[t]` has bit `c - 'a'` set for each letter c of target t.
+void OrderTargets(const std::vector<uint32_t>& letters, uint16_t* begin,
+                  uint16_t* end) {
+  const int size = end - begin;
+  int best_letter = -1;
+  int best_balance = 0;
+  for (int c = 0; c < 26; ++c) {
+    int with = 0;
+    for (const uint16_t* t = begin; t != end; ++t) {
+      with += (letters[*t] >> c) & 1;
+    }
+    const int balance = std::min(with, size - with);
+    if (balance > best_balance) {
+      best_letter = c;
+      best_balance = balance;
+    }
+  }
+  if (best_letter < 0) return;
+  uint16_t* mid = std::stable_partition(begin, end, [&](uint16_t target) {
+    return !((letters[target] >> best_letter) & 1);
+  });
+  OrderTargets(letters, begin, mid);
+  OrderTargets(letters, mid, end);
+}
+
+// Returns a target order (see SetTargetOrder) that clusters words with
+// similar letters.  Feedback from a guess mostly depends on which of its
+// letters a target has, so each mask's targets tend to share 64-bit words,
+// and the compact tables and branch kernel touch fewer of them.
+std::vector<uint16_t> PermutedTargetOrder() {
+  std::vector<uint32_t> letters(kNumTargets);
+  std::vector<uint16_t> order(kNumTargets);
+  for (int i = 0; i < kNumTargets; ++i) {
+    const PackedWord packed = Word(i).Packed();
+    for (int j = 0; j < 5; ++j) {
+      letters[i] |= uint32_t{1} << (packed.Letter(j) - 1);
+    }
+    order[i] = i;
+  }
+  OrderTargets(letters, order.data(), order.data() + order.size());
+  return order;
+}
+
+// Returns `guess` with the letters not in `letters` replaced by wildcards.
+PackedWord PartialGuess(Word guess, uint32_t letters) {
+  const PackedWord packed = guess.Packed();
+  uint64_t bits = 0;
+  for (int i = 0; i < 5; ++i) {
+    const int letter = packed.Letter(i);
+    if (letters & (uint32_t{1} << (letter - 1))) {
+      bits |= uint64_t(letter) << (8 * i);
+    }
+  }
+  return PackedWord(bits);
+}
 
 struct Branch {
   Colors colors;
-  int vowel_index;
-  int consonant_index;
+  std::array<int, raw::kMaxFactors> mask_index;
   int bit_count;
 };
 
-struct Guess {
-  Word word;
-  std::vector<Branch> branches;
+// One branch of a guess before its masks are numbered: the colors, and a
+// mask per factor.
+struct PendingBranch {
+  Colors colors;
+  std::array<const Mask*, raw::kMaxFactors> masks;
 };
 
-std::vector<Branch> ScoreWord(Word guess, StateIndexer& vowel_indexer,
-                              StateIndexer& consonant_indexer) {
-  char vowel_guess[] = "*****";
-  char consonant_guess[] = "*****";
-  const char* full_guess = guess.ToString();
-  for (int i = 0; i < 5; ++i) {
-    char letter = full_guess[i];
-    if (letter == 'a' || letter == 'e' || letter == 'i' || letter == 'o' ||
-        letter == 'u' || letter == 'y' || letter == 's') {
-      vowel_guess[i] = letter;
-    } else {
-      consonant_guess[i] = letter;
+// Scratch space for bucketing targets by color code: one target bitmask per
+// code.  Buckets are cleared after use, so only the ones that were touched
+// get rewritten.  This avoids building a map of bitsets per guess.
+struct BucketSpace {
+  BucketSpace() {
+    for (Mask& mask : masks) {
+      mask.fill(0);
     }
   }
-  std::map<Colors, std::bitset<kNumTargets>> vowel_masks;
-  std::map<Colors, std::bitset<kNumTargets>> consonant_masks;
-  std::map<Colors, std::pair<Colors, Colors>> splits;
-  int idx = 0;
-  for (Word target : Word::AllTargetWords()) {
-    const char* full_target = target.ToString();
-    Colors full_colors = ColorGuess(guess, target);
-    Colors vowel_colors = ColorGuess(vowel_guess, full_target);
-    Colors consonant_colors = ColorGuess(consonant_guess, full_target);
-    vowel_masks[vowel_colors].set(idx);
-    consonant_masks[consonant_colors].set(idx);
-    if (target != guess) {
-      splits[full_colors] = std::make_pair(vowel_colors, consonant_colors);
+  std::array<Mask, kNumColorCodes> masks;
+};
+
+// Buckets the targets by `codes`, which are indexed by target, and calls
+// `fn(code, mask)` for each nonempty bucket in code order.  Masks use the
+// installed target order.  Leaves `space` cleared.
+template <typename Fn>
+void ForEachBucket(const uint8_t* codes, BucketSpace& space, Fn fn) {
+  std::bitset<kNumColorCodes> present;
+  for (int idx = 0; idx < kNumTargets; ++idx) {
+    const int bit = BitOfTarget(Word(idx));
+    space.masks[codes[idx]][bit / 64] |= uint64_t{1} << (bit % 64);
+    present.set(codes[idx]);
+  }
+  for (int code = 0; code < kNumColorCodes; ++code) {
+    if (present[code]) {
+      fn(code, space.masks[code]);
+      space.masks[code].fill(0);
     }
-    ++idx;
   }
+}
+
+// Colors every target against each group's part of `guess`.
+void FactorCodes(Word guess, const Grouping& grouping,
+                 uint8_t (&codes)[raw::kMaxFactors][kNumTargets]) {
+  const PackedWord* targets = Word::AllPackedWords().data();
+  for (int f = 0; f < grouping.size(); ++f) {
+    ColorGuessBatch(PartialGuess(guess, grouping.letters[f]), targets,
+                    kNumTargets, codes[f]);
+  }
+}
 
-  std::map<Colors, int> vowel_indices;
-  for (const auto& node : vowel_masks) {
-    vowel_indices[node.first] = vowel_indexer.Index(node.second);
+// Returns the branches of `guess` in color code order, with each factor mask
+// interned in the corresponding entry of `sets`.
+std::vector<PendingBranch> ScoreWord(Word guess, const Grouping& grouping,
+                                     ConcurrentMaskSet* sets) {
+  const uint8_t* full_codes = ColorTable::Get().Row(guess);
+  uint8_t factor_codes[raw::kMaxFactors][kNumTargets];
+  FactorCodes(guess, grouping, factor_codes);
+
+  thread_local BucketSpace space;
+  std::array<std::array<const Mask*, kNumColorCodes>, raw::kMaxFactors>
+      buckets;
+  for (int f = 0; f < grouping.size(); ++f) {
+    ForEachBucket(factor_codes[f], space, [&](int code, const Mask& mask) {
+      buckets[f][code] = sets[f].Insert(mask);
+    });
   }
-  std::map<Colors, int> consonant_indices;
-  for (const auto& node : consonant_masks) {
-    consonant_indices[node.first] = consonant_indexer.Index(node.second);
+
+  // Any target with a given full code determines that branch's factor codes.
+  std::bitset<kNumColorCodes> present;
+  std::array<int, kNumColorCodes> example;
+  for (int idx = 0; idx < kNumTargets; ++idx) {
+    if (idx == guess.ToIndex()) continue;
+    present.set(full_codes[idx]);
+    example[full_codes[idx]] = idx;
+  }
+  std::vector<PendingBranch> branches;
+  for (int code = 0; code < kNumColorCodes; ++code) {
+    if (present[code]) {
+      PendingBranch& br = branches.emplace_back();
+      br.colors = Colors::FromCode(code);
+      for (int f = 0; f < grouping.size(); ++f) {
+        br.masks[f] = buckets[f][factor_codes[f][example[code]]];
+      }
+    }
   }
-  std::vector<Branch> branches;
-  for (const auto& node : splits) {
-    Branch br;
-    br.colors = node.first;
-    br.vowel_index = vowel_indices[node.second.first];
-    br.consonant_index = consonant_indices[node.second.second];
-    State mask = vowel_indexer.Lookup(br.vowel_index) &
-                 consonant_indexer.Lookup(br.consonant_index);
-    br.bit_count = mask.count();
-    branches.push_back(br);
-    g_all_indices.insert(std::make_pair(br.vowel_index, br.consonant_index));
-  }
-  std::stable_sort(branches.begin(), branches.end(),
-                   [](const Branch& lhs, const Branch& rhs) {
-                     return lhs.bit_count > rhs.bit_count;
-                   });
   return branches;
 }
 
-void emit_table(std::string_view name, const StateIndexer& indexer) {
+// A mask table in the compact form described in raw_blob.h.
+struct CompactTable {
+  explicit CompactTable(const std::vector<Mask>& masks) {
+    for (const Mask& mask : masks) {
+      uint64_t present = 0;
+      const uint64_t offset = words.size();
+      for (int i = 0; i < State::kNumWords; ++i) {
+        if (mask[i] != 0) {
+          present |= uint64_t{1} << i;
+          words.push_back(mask[i]);
+        }
+      }
+      headers.push_back((offset << raw::kCompactOffsetShift) | present);
+    }
+  }
+
+  std::vector<uint64_t> headers;
+  std::vector<uint64_t> words;
+};
+
+// The complete set of tables, in output order.
+struct Tables {
+  struct GuessRange {
+    Word word;
+    uint32_t offset;
+    uint32_t size;
+  };
+  Grouping grouping;
+  // The target at each bit of the masks.
+  std::vector<uint16_t> target_order;
+  std::vector<std::vector<Mask>> factor_masks;
+  std::vector<Branch> branches;
+  std::vector<GuessRange> guesses;
+};
+
+// Builds the tables from the branches of every word, indexed by Word.
+// Branches must be in color code order; any with no targets are dropped.
+//
+// Guesses are laid out by the size of their largest branch, with their
+// branches largest first, and masks are numbered in order of first use along
+// that layout.  SubPartitions walks the tables in the same order, so each
+// guess's new masks are adjacent and its reused ones were used recently.  The
+// result depends only on the branches and not on how they were found.
+Tables AssembleTables(const Grouping& grouping,
+                      const std::vector<std::vector<PendingBranch>>& pending) {
+  struct Guess {
+    Word word;
+    std::vector<Branch> branches;
+    // The masks of each branch, in the same order.
+    std::vector<const PendingBranch*> sources;
+  };
+  std::vector<Guess> guesses;
+  for (Word w : Word::AllWords()) {
+    Guess& g = guesses.emplace_back();
+    g.word = w;
+    std::vector<std::pair<Branch, const PendingBranch*>> branches;
+    for (const PendingBranch& p : pending[w.ToIndex()]) {
+      Mask mask = State::AllBits().array();
+      for (int f = 0; f < grouping.size(); ++f) {
+        for (int i = 0; i < State::kNumWords; ++i) {
+          mask[i] &= (*p.masks[f])[i];
+        }
+      }
+      int bit_count = 0;
+      for (uint64_t word : mask) {
+        bit_count += absl::popcount(word);
+      }
+      if (bit_count == 0) continue;
+      Branch br;
+      br.colors = p.colors;
+      br.bit_count = bit_count;
+      br.mask_index.fill(0);
+      branches.emplace_back(br, &p);
+    }
+    std::stable_sort(branches.begin(), branches.end(),
+                     [](const auto& lhs, const auto& rhs) {
+                       return lhs.first.bit_count > rhs.first.bit_count;
+                     });
+    for (const auto& [br, source] : branches) {
+      g.branches.push_back(br);
+      g.sources.push_back(source);
+    }
+  }
+  std::stable_sort(
+      guesses.begin(), guesses.end(), [](const Guess& lhs, const Guess& rhs) {
+        return lhs.branches.front().bit_count < rhs.branches.front().bit_count;
+      });
+
+  std::vector<MaskNumbering> numberings(grouping.size());
+  for (Guess& guess : guesses) {
+    for (int b = 0; b < int(guess.branches.size()); ++b) {
+      for (int f = 0; f < grouping.size(); ++f) {
+        guess.branches[b].mask_index[f] =
+            numberings[f].Index(guess.sources[b]->masks[f]);
+      }
+    }
+  }
+
+  Tables tables;
+  tables.grouping = grouping;
+  for (int bit = 0; bit < kNumTargets; ++bit) {
+    tables.target_order.push_back(TargetAtBit(bit).ToIndex());
+  }
+  for (MaskNumbering& numbering : numberings) {
+    tables.factor_masks.push_back(numbering.TakeMasks());
+  }
+  for (const Guess& guess : guesses) {
+    Tables::GuessRange range;
+    range.word = guess.word;
+    range.offset = tables.branches.size();
+    range.size = guess.branches.size();
+    tables.branches.insert(tables.branches.end(), guess.branches.begin(),
+                           guess.branches.end());
+    tables.guesses.push_back(range);
+  }
+  return tables;
+}
+
+// Returns true if every factor table can be indexed by the 16-bit
+// mask_index of the output, after logging the first that can't.
+bool FitsMaskIndices(const Tables& tables) {
+  for (int f = 0; f < tables.grouping.size(); ++f) {
+    if (tables.factor_masks[f].size() > raw::kMaxFactorMasks) {
+      std::cerr << "Factor " << f << " has " << tables.factor_masks[f].size()
+                << " masks, more than the " << raw::kMaxFactorMasks
+                << " the tables can index\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+// Scores `words` in parallel, filling in their entries of `pending`.
+void ScoreWords(const std::vector<Word>& words, const Grouping& grouping,
+                ConcurrentMaskSet* sets,
+                std::vector<std::vector<PendingBranch>>& pending) {
+  std::vector<std::function<int()>> fns;
+  for (Word w : words) {
+    fns.push_back([&, w] {
+      pending[w.ToIndex()] = ScoreWord(w, grouping, sets);
+      return 0;
+    });
+  }
+  ColorTable::Get();  // Initialize before fanning out.
+  RunThreads(std::thread::hardware_concurrency(), std::move(fns), [](int) {});
+}
+
+Tables MakeTables(const Grouping& grouping) {
+  std::array<ConcurrentMaskSet, raw::kMaxFactors> sets;
+  std::vector<std::vector<PendingBranch>> pending(kDictionarySize);
+  ScoreWords(Word::AllWords(), grouping, sets.data(), pending);
+  return AssembleTables(grouping, pending);
+}
+
+bool operator==(const Branch& lhs, const Branch& rhs) {
+  return lhs.colors.ToInt() == rhs.colors.ToInt() &&
+         lhs.mask_index == rhs.mask_index && lhs.bit_count == rhs.bit_count;
+}
+
+bool operator==(const Tables::GuessRange& lhs, const Tables::GuessRange& rhs) {
+  return lhs.word.ToIndex() == rhs.word.ToIndex() &&
+         lhs.offset == rhs.offset && lhs.size == rhs.size;
+}
+
+bool operator==(const Tables& lhs, const Tables& rhs) {
+  return lhs.grouping.letters == rhs.grouping.letters &&
+         lhs.target_order == rhs.target_order &&
+         lhs.factor_masks == rhs.factor_masks &&
+         lhs.branches == rhs.branches && lhs.guesses == rhs.guesses;
+}
+
+// Tables read back from an earlier --blob file, possibly built from a
+// different dictionary.
+class PreviousTables {
+ public:
+  // Returns nullptr, after logging why, if `path` is not a valid blob.
+  static std::unique_ptr<PreviousTables> Read(const std::string& path) {
+    auto prev = absl::WrapUnique(new PreviousTables);
+    prev->file_ = MappedFile::Open(path);
+    if (!prev->file_ || !prev->Init()) {
+      std::cerr << path << " is not a valid version " << raw::kBlobVersion
+                << " raw table file\n";
+      return nullptr;
+    }
+    return prev;
+  }
+
+  const raw::BlobHeader& header() const { return header_; }
+  const Grouping& grouping() const { return grouping_; }
+
+  // The packed letters of each word, in the previous dictionary's order.
+  absl::Span<const uint64_t> words() const { return words_; }
+
+  // The previous target at each bit of the masks.
+  absl::Span<const uint16_t> target_order() const { return target_order_; }
+
+  // Returns true if the previous tables used a permuted target order.
+  bool permuted() const {
+    for (int i = 0; i < int(target_order_.size()); ++i) {
+      if (target_order_[i] != i) return true;
+    }
+    return false;
+  }
+
+  // Returns mask `index` of factor `f`, which is header().num_words long.
+  const uint64_t* FactorMask(int f, int index) const {
+    return factor_masks_[f] + uint64_t(index) * header_.num_words;
+  }
+
+  // Returns the branches of the word with previous index `word`.
+  absl::Span<const raw::BlobBranch> Branches(int word) const {
+    return branches_[word];
+  }
+
+ private:
+  PreviousTables() = default;
+
+  bool Init() {
+    if (file_->size() < sizeof(header_)) return false;
+    memcpy(&header_, file_->data(), sizeof(header_));
+    if (memcmp(header_.magic, raw::kBlobMagic, sizeof(raw::kBlobMagic)) != 0 ||
+        header_.version != raw::kBlobVersion ||
+        header_.total_size != file_->size() ||
+        header_.num_targets > header_.num_guesses ||
+        header_.num_words != (header_.num_targets + 63) / 64 ||
+        !raw::BlobSectionsFit(header_)) {
+      return false;
+    }
+    words_ = absl::MakeConstSpan(Section<uint64_t>(header_.words_offset),
+                                 header_.num_guesses);
+    target_order_ = absl::MakeConstSpan(
+        Section<uint16_t>(header_.target_order_offset), header_.num_targets);
+    if (!raw::IsTargetOrder(target_order_.data(), header_.num_targets)) {
+      return false;
+    }
+    for (uint32_t f = 0; f < header_.num_factors; ++f) {
+      grouping_.letters.push_back(header_.factors[f].letters);
+      factor_masks_.push_back(
+          Section<uint64_t>(header_.factors[f].masks_offset));
+    }
+    const raw::BlobBranch* branches =
+        Section<raw::BlobBranch>(header_.branches_offset);
+    const raw::BlobGuess* guesses =
+        Section<raw::BlobGuess>(header_.guesses_offset);
+    branches_.resize(header_.num_guesses);
+    for (uint32_t i = 0; i < header_.num_guesses; ++i) {
+      const raw::BlobGuess& g = guesses[i];
+      if (g.word >= header_.num_guesses ||
+          uint64_t{g.first_branch} + g.num_branches > header_.num_branches) {
+        return false;
+      }
+      branches_[g.word] =
+          absl::MakeConstSpan(branches + g.first_branch, g.num_branches);
+      for (const raw::BlobBranch& br : branches_[g.word]) {
+        for (uint32_t f = 0; f < header_.num_factors; ++f) {
+          if (br.mask_index[f] >= header_.factors[f].num_masks) return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  template <typename T>
+  const T* Section(uint64_t offset) const {
+    return reinterpret_cast<const T*>(file_->data() + offset);
+  }
+
+  std::unique_ptr<MappedFile> file_;
+  raw::BlobHeader header_;
+  Grouping grouping_;
+  absl::Span<const uint64_t> words_;
+  absl::Span<const uint16_t> target_order_;
+  std::vector<const uint64_t*> factor_masks_;
+  std::vector<absl::Span<const raw::BlobBranch>> branches_;
+};
+
+// Builds tables for the current dictionary from `prev`, which must not lack
+// any current target.  Words that were already guesses keep their branches,
+// with the masks rewritten for the installed target order; only new words
+// are scored.  Since AssembleTables only looks at the branches, the result
+// is the same as MakeTables(prev.grouping()).  Returns false if the targets
+// don't allow this.
+bool MakeTablesIncrementally(const PreviousTables& prev, Tables* tables) {
+  const raw::BlobHeader& header = prev.header();
+  absl::flat_hash_map<uint64_t, Word> current;
+  for (Word w : Word::AllWords()) {
+    current[w.Packed().bits()] = w;
+  }
+  // Where each previous bit moves to, or -1 if its target is gone.
+  std::vector<int> bit_map(header.num_targets, -1);
+  int kept_targets = 0;
+  for (uint32_t i = 0; i < header.num_targets; ++i) {
+    auto it = current.find(prev.words()[prev.target_order()[i]]);
+    if (it != current.end() && it->second.ToIndex() < kNumTargets) {
+      bit_map[i] = BitOfTarget(it->second);
+      ++kept_targets;
+    }
+  }
+  if (kept_targets != kNumTargets) {
+    std::cerr << "The dictionary adds targets, so every mask changes\n";
+    return false;
+  }
+
+  const Grouping& grouping = prev.grouping();
+  std::vector<std::vector<Mask>> remapped(grouping.size());
+  for (int f = 0; f < grouping.size(); ++f) {
+    remapped[f].resize(header.factors[f].num_masks);
+    for (uint32_t m = 0; m < header.factors[f].num_masks; ++m) {
+      const uint64_t* old_mask = prev.FactorMask(f, m);
+      Mask& mask = remapped[f][m];
+      mask.fill(0);
+      for (uint32_t i = 0; i < header.num_words; ++i) {
+        for (uint64_t word = old_mask[i]; word != 0; word &= word - 1) {
+          const int old_bit = 64 * i + absl::countr_zero(word);
+          if (old_bit < int(header.num_targets) && bit_map[old_bit] >= 0) {
+            const int bit = bit_map[old_bit];
+            mask[bit / 64] |= uint64_t{1} << (bit % 64);
+          }
+        }
+      }
+    }
+  }
+
+  std::vector<std::vector<PendingBranch>> pending(kDictionarySize);
+  std::vector<bool> seen(kDictionarySize);
+  for (uint32_t i = 0; i < header.num_guesses; ++i) {
+    auto it = current.find(prev.words()[i]);
+    if (it == current.end()) continue;
+    std::vector<PendingBranch>& branches = pending[it->second.ToIndex()];
+    seen[it->second.ToIndex()] = true;
+    for (const raw::BlobBranch& br : prev.Branches(i)) {
+      PendingBranch& p = branches.emplace_back();
+      p.colors = Colors(br.colors);
+      for (int f = 0; f < grouping.size(); ++f) {
+        p.masks[f] = &remapped[f][br.mask_index[f]];
+      }
+    }
+    std::sort(branches.begin(), branches.end(),
+              [](const PendingBranch& lhs, const PendingBranch& rhs) {
+                return lhs.colors.ToCode() < rhs.colors.ToCode();
+              });
+  }
+  std::vector<Word> added;
+  for (Word w : Word::AllWords()) {
+    if (!seen[w.ToIndex()]) {
+      added.push_back(w);
+    }
+  }
+  std::cerr << "Reusing " << kDictionarySize - added.size()
+            << " guesses and scoring " << added.size() << "; "
+            << header.num_targets - kNumTargets << " targets removed\n";
+  std::array<ConcurrentMaskSet, raw::kMaxFactors> sets;
+  ScoreWords(added, grouping, sets.data(), pending);
+  *tables = AssembleTables(grouping, pending);
+  return true;
+}
+
+// What searching for a grouping optimizes.
+enum class Objective {
+  // Bytes of the plain and compact factor tables.
+  kTableBytes,
+  // Words read by the compact branch kernel, summed over all branches.
+  kAndWords,
+};
+
+// The cost of a grouping, estimated from a sample of the guesses.
+struct GroupingCost {
+  int64_t table_bytes = 0;
+  int64_t and_words = 0;
+  // The most masks in any factor table.  Only the sampled guesses
+  // contribute, so this is a lower bound unless every guess is sampled.
+  int64_t max_masks = 0;
+
+  int64_t Get(Objective objective) const {
+    return objective == Objective::kTableBytes ? table_bytes : and_words;
+  }
+};
+
+// Scores every `stride`th guess under `grouping`, without building tables.
+// Table bytes count each distinct sampled mask once; AND words count, for
+// each sampled branch, the words present in all of its factor masks, once
+// per factor.  With a stride of 1, max_masks is at least the size of every
+// factor table MakeTables would build.
+GroupingCost EstimateCost(const Grouping& grouping, int stride) {
+  std::array<absl::flat_hash_set<Mask>, raw::kMaxFactors> seen;
+  GroupingCost cost;
+  thread_local BucketSpace space;
+  const std::vector<Word>& words = Word::AllWords();
+  for (int w = 0; w < int(words.size()); w += stride) {
+    const Word guess = words[w];
+    uint8_t factor_codes[raw::kMaxFactors][kNumTargets];
+    FactorCodes(guess, grouping, factor_codes);
+    std::array<std::array<uint64_t, kNumColorCodes>, raw::kMaxFactors>
+        present;
+    for (int f = 0; f < grouping.size(); ++f) {
+      ForEachBucket(factor_codes[f], space, [&](int code, const Mask& mask) {
+        uint64_t bits = 0;
+        for (int i = 0; i < State::kNumWords; ++i) {
+          if (mask[i] != 0) {
+            bits |= uint64_t{1} << i;
+          }
+        }
+        present[f][code] = bits;
+        if (seen[f].insert(mask).second) {
+          cost.table_bytes +=
+              sizeof(Mask) + sizeof(uint64_t) * (1 + absl::popcount(bits));
+        }
+      });
+    }
+    const uint8_t* full_codes = ColorTable::Get().Row(guess);
+    std::bitset<kNumColorCodes> done;
+    for (int idx = 0; idx < kNumTargets; ++idx) {
+      if (idx == guess.ToIndex() || done[full_codes[idx]]) continue;
+      done.set(full_codes[idx]);
+      uint64_t bits = ~uint64_t{0};
+      for (int f = 0; f < grouping.size(); ++f) {
+        bits &= present[f][factor_codes[f][idx]];
+      }
+      cost.and_words += grouping.size() * absl::popcount(bits);
+    }
+  }
+  for (int f = 0; f < grouping.size(); ++f) {
+    // Plus the empty mask, which every table starts with.
+    cost.max_masks = std::max<int64_t>(cost.max_masks, seen[f].size() + 1);
+  }
+  return cost;
+}
+
+// A starting point for SearchGrouping: "aeiouys" in the first group, and the
+// remaining letters dealt out among the others.
+Grouping InitialGrouping(int num_groups) {
+  Grouping grouping = DefaultGrouping();
+  const uint32_t rest = grouping.letters[1];
+  grouping.letters.resize(1);
+  grouping.letters.resize(num_groups, 0);
+  int next = 1;
+  for (int c = 0; c < 26; ++c) {
+    if (rest & (uint32_t{1} << c)) {
+      grouping.letters[next] |= uint32_t{1} << c;
+      next = (next % (num_groups - 1)) + 1;
+    }
+  }
+  return grouping;
+}
+
+// Hill-climbs from InitialGrouping(num_groups), moving one letter between
+// groups at a time, until no move lowers the estimated cost.  Moves that
+// would give a factor more masks than the tables can index are skipped;
+// neither objective rules them out, and the AND objective favors them.
+Grouping SearchGrouping(int num_groups, Objective objective) {
+  constexpr int kSampleStride = 8;
+  ColorTable::Get();  // Initialize before fanning out.
+  Grouping best = InitialGrouping(num_groups);
+  GroupingCost best_cost = EstimateCost(best, kSampleStride);
+  while (true) {
+    std::cerr << best.ToString() << ": " << best_cost.table_bytes
+              << " table bytes, " << best_cost.and_words << " AND words\n";
+    std::vector<Grouping> candidates;
+    for (int from = 0; from < num_groups; ++from) {
+      if (absl::popcount(best.letters[from]) == 1) continue;
+      for (int c = 0; c < 26; ++c) {
+        const uint32_t bit = uint32_t{1} << c;
+        if (!(best.letters[from] & bit)) continue;
+        for (int to = 0; to < num_groups; ++to) {
+          if (to == from) continue;
+          Grouping moved = best;
+          moved.letters[from] &= ~bit;
+          moved.letters[to] |= bit;
+          candidates.push_back(moved);
+        }
+      }
+    }
+    std::vector<GroupingCost> costs(candidates.size());
+    std::vector<std::function<int()>> fns;
+    for (int i = 0; i < int(candidates.size()); ++i) {
+      fns.push_back([&, i] {
+        costs[i] = EstimateCost(candidates[i], kSampleStride);
+        return 0;
+      });
+    }
+    RunThreads(std::thread::hardware_concurrency(), std::move(fns),
+               [](int) {});
+    std::vector<bool> too_big(candidates.size());
+    for (int i = 0; i < int(candidates.size()); ++i) {
+      too_big[i] = costs[i].max_masks > raw::kMaxFactorMasks;
+    }
+    int best_index;
+    while (true) {
+      best_index = -1;
+      for (int i = 0; i < int(candidates.size()); ++i) {
+        if (too_big[i]) continue;
+        const int64_t incumbent = best_index < 0
+                                      ? best_cost.Get(objective)
+                                      : costs[best_index].Get(objective);
+        if (costs[i].Get(objective) < incumbent) {
+          best_index = i;
+        }
+      }
+      if (best_index < 0) {
+        return best;
+      }
+      // The sample undercounts masks, so count them all before moving.
+      if (EstimateCost(candidates[best_index], 1).max_masks <=
+          raw::kMaxFactorMasks) {
+        break;
+      }
+      too_big[best_index] = true;
+    }
+    best = candidates[best_index];
+    best_cost = costs[best_index];
+  }
+}
+
+void EmitMasks(std::string_view name, const std::vector<Mask>& masks) {
   absl::PrintF(
       "  constexpr std::array<uint64_t, %d> %s[%d] = {\n   ",
-      State::kNumWords, name, indexer.size());
-  for (int i = 0; i < indexer.size(); ++i) {
+      State::kNumWords, name, masks.size());
+  for (int i = 0; i < int(masks.size()); ++i) {
     absl::PrintF(" {{  // %d\n      ", i);
     for (int j = 0; j < State::kNumWords; ++j) {
       int precision = (j != State::kNumWords - 1) ? 16 : 3;
-      absl::PrintF("0x%0*x, ", precision, indexer.Lookup(i).array()[j]);
+      absl::PrintF("0x%0*x, ", precision, masks[i][j]);
       if (j % 3 == 2 && j != State::kNumWords - 2) {
         absl::PrintF("\n      ");
       }
@@ -129,77 +832,281 @@ void emit_table(std::string_view name, const StateIndexer& indexer) {
   absl::PrintF("\n  };\n\n");
 }
 
-void make_tables() {
-  StateIndexer vowel_indexer;
-  StateIndexer consonant_indexer;
-  std::vector<Guess> guesses;
-  for (Word w : Word::AllWords()) {
-    Guess g;
-    g.word = w;
-    g.branches = ScoreWord(w, vowel_indexer, consonant_indexer);
-    guesses.push_back(g);
+void EmitWords(std::string_view name, const std::vector<uint64_t>& words) {
+  absl::PrintF("  constexpr uint64_t %s[%d] = {", name, words.size());
+  for (int i = 0; i < int(words.size()); ++i) {
+    absl::PrintF("%s0x%016x,", (i % 4 == 0) ? "\n     " : " ", words[i]);
   }
-  std::stable_sort(
-      guesses.begin(), guesses.end(), [](const Guess& lhs, const Guess& rhs) {
-        return lhs.branches.front().bit_count < rhs.branches.front().bit_count;
-      });
+  absl::PrintF("\n  };\n\n");
+}
 
-  std::set<StateId> ids;
-  for (auto p : g_all_indices) {
-    ids.insert(
-        (vowel_indexer.Lookup(p.first) & consonant_indexer.Lookup(p.second))
-            .ToStateId());
+// Prints the tables as a C++ source file implementing raw_data.h.
+void EmitSource(const Tables& tables) {
+  const int num_factors = tables.grouping.size();
+  absl::PrintF(
+      "#include \"raw_data.h\"\n"
+      "#include <array>\n"
+      "#include <cstdint>\n"
+      "\n"
+      "// Letter groups: %s\n"
+      "\n"
+      "namespace raw {\n",
+      tables.grouping.ToString());
+  for (int f = 0; f < num_factors; ++f) {
+    EmitMasks(absl::StrFormat("factor%d_mask_data", f),
+              tables.factor_masks[f]);
   }
 
-  emit_table("vowel_masks", vowel_indexer);
-  emit_table("consonant_masks", consonant_indexer);
-
-  std::vector<Branch> all_branches;
-  struct LocalGuess {
-    Word word;
-    uint32_t offset;
-    uint32_t size;
-  };
-  std::vector<LocalGuess> local_guesses;
-
-  for (const Guess& guess : guesses) {
-    LocalGuess local_guess;
-    local_guess.word = guess.word;
-    local_guess.offset = all_branches.size();
-    local_guess.size = guess.branches.size();
-    all_branches.insert(all_branches.end(), guess.branches.begin(),
-                        guess.branches.end());
-    local_guesses.push_back(local_guess);
+  absl::PrintF("  constexpr uint16_t target_order_data[%d] = {",
+               tables.target_order.size());
+  for (int i = 0; i < int(tables.target_order.size()); ++i) {
+    absl::PrintF("%s%4d,", (i % 12 == 0) ? "\n     " : " ",
+                 tables.target_order[i]);
   }
+  absl::PrintF("\n  };\n\n");
 
+  const std::vector<Branch>& all_branches = tables.branches;
   absl::PrintF(
-      "  constexpr Indices mask_pairs[%d] = {\n   ",
+      "  constexpr Indices branch_data[%d] = {\n   ",
       all_branches.size());
   for (int i = 0; i < int(all_branches.size()); ++i) {
-    absl::PrintF(" %4d, %5d, %5d,", all_branches[i].colors.ToInt(),
-                 all_branches[i].vowel_index, all_branches[i].consonant_index);
-    if (i % 3 == 2) {
+    const Branch& br = all_branches[i];
+    absl::PrintF(" %4d, %4d, %5d, %5d, %5d, %5d,", br.colors.ToInt(),
+                 br.bit_count, br.mask_index[0], br.mask_index[1],
+                 br.mask_index[2], br.mask_index[3]);
+    if (i % 2 == 1) {
       absl::PrintF("\n   ");
     }
   }
   absl::PrintF("  };\n\n");
 
-  absl::PrintF("  constexpr Guess guesses[%d] = {\n", local_guesses.size());
-  for (const LocalGuess& local_guess : local_guesses) {
-    absl::PrintF("    Guess(%5d, mask_pairs + %7d, %3d),  // %s\n",
+  absl::PrintF("  constexpr Guess guess_data[%d] = {\n",
+               tables.guesses.size());
+  for (const Tables::GuessRange& local_guess : tables.guesses) {
+    absl::PrintF("    Guess(%5d, branch_data + %7d, %3d),  // %s\n",
                  local_guess.word.ToIndex(), local_guess.offset,
                  local_guess.size, local_guess.word.ToString());
   }
   absl::PrintF("  };\n\n");
-}
 
-int main(int argc, char** argv) {
+  for (int f = 0; f < num_factors; ++f) {
+    const CompactTable compact(tables.factor_masks[f]);
+    EmitWords(absl::StrFormat("factor%d_compact_headers", f), compact.headers);
+    EmitWords(absl::StrFormat("factor%d_compact_words", f), compact.words);
+  }
+
+  absl::PrintF("int num_factors = %d;\n", num_factors);
+  absl::PrintF("absl::Span<const Mask> factor_masks[kMaxFactors] = {\n");
+  for (int f = 0; f < num_factors; ++f) {
+    absl::PrintF("    factor%d_mask_data,\n", f);
+  }
+  absl::PrintF("};\n");
+  absl::PrintF("CompactMaskTable compact_factor_masks[kMaxFactors] = {\n");
+  for (int f = 0; f < num_factors; ++f) {
+    absl::PrintF("    {factor%d_compact_headers, factor%d_compact_words},\n",
+                 f, f);
+  }
   absl::PrintF(
-      "#include \"raw_data.h\"\n"
-      "#include <array>\n"
-      "#include <cstdint>\n"
+      "};\n"
+      "absl::Span<const Guess> guesses(guess_data);\n"
       "\n"
-      "namespace raw {\n");
-  make_tables();
-  absl::PrintF("}  // namespace raw\n");
-}
\ No newline at end of file
+      "namespace {\n"
+      "\n"
+      "// The tables above are constant-initialized, so they are ready by now.\n"
+      "struct TablesInstaller {\n"
+      "  TablesInstaller() {\n"
+      "    wordle::SetTargetOrder(target_order_data);\n"
+      "    MaybeUseHugePages();\n"
+      "  }\n"
+      "};\n"
+      "__attribute__((init_priority(kTablesInitPriority)))\n"
+      "const TablesInstaller installer;\n"
+      "\n"
+      "}  // namespace\n"
+      "\n"
+      "}  // namespace raw\n");
+}
+
+// Appends `size` bytes at `data` to `out`, after padding `out` to the blob
+// alignment.  Returns the offset the data was written at.
+uint64_t AppendSection(std::string& out, const void* data, size_t size) {
+  out.resize((out.size() + raw::kBlobAlignment - 1) / raw::kBlobAlignment *
+             raw::kBlobAlignment);
+  uint64_t offset = out.size();
+  out.append(static_cast<const char*>(data), size);
+  return offset;
+}
+
+// Writes the tables in the binary format described in raw_blob.h.
+bool WriteBlob(const Tables& tables, const std::string& path) {
+  std::vector<raw::BlobBranch> branches;
+  for (const Branch& br : tables.branches) {
+    raw::BlobBranch blob_branch;
+    blob_branch.colors = br.colors.ToInt();
+    blob_branch.bit_count = br.bit_count;
+    for (int f = 0; f < raw::kMaxFactors; ++f) {
+      blob_branch.mask_index[f] = br.mask_index[f];
+    }
+    branches.push_back(blob_branch);
+  }
+  std::vector<raw::BlobGuess> guesses;
+  for (const Tables::GuessRange& range : tables.guesses) {
+    guesses.push_back({uint16_t(range.word.ToIndex()), uint16_t(range.size),
+                       range.offset});
+  }
+
+  raw::BlobHeader header = {};
+  memcpy(header.magic, raw::kBlobMagic, sizeof(header.magic));
+  header.version = raw::kBlobVersion;
+  header.num_targets = kNumTargets;
+  header.num_words = State::kNumWords;
+  header.num_factors = tables.grouping.size();
+  header.num_branches = branches.size();
+  header.num_guesses = guesses.size();
+
+  std::string out(sizeof(header), '\0');
+  const std::vector<PackedWord>& words = Word::AllPackedWords();
+  header.words_offset =
+      AppendSection(out, words.data(), words.size() * sizeof(PackedWord));
+  header.target_order_offset =
+      AppendSection(out, tables.target_order.data(),
+                    tables.target_order.size() * sizeof(uint16_t));
+  header.branches_offset = AppendSection(
+      out, branches.data(), branches.size() * sizeof(raw::BlobBranch));
+  header.guesses_offset = AppendSection(
+      out, guesses.data(), guesses.size() * sizeof(raw::BlobGuess));
+  for (int f = 0; f < tables.grouping.size(); ++f) {
+    const std::vector<Mask>& masks = tables.factor_masks[f];
+    const CompactTable compact(masks);
+    raw::BlobFactor& factor = header.factors[f];
+    factor.letters = tables.grouping.letters[f];
+    factor.num_masks = masks.size();
+    factor.num_compact_words = compact.words.size();
+    factor.masks_offset =
+        AppendSection(out, masks.data(), masks.size() * sizeof(Mask));
+    factor.compact_headers_offset =
+        AppendSection(out, compact.headers.data(),
+                      compact.headers.size() * sizeof(uint64_t));
+    factor.compact_words_offset = AppendSection(
+        out, compact.words.data(), compact.words.size() * sizeof(uint64_t));
+  }
+  header.total_size = out.size();
+  memcpy(out.data(), &header, sizeof(header));
+
+  FILE* f = fopen(path.c_str(), "wb");
+  if (!f) {
+    return false;
+  }
+  bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+  return (fclose(f) == 0) && ok;
+}
+
+void Usage(const char* argv0) {
+  std::cerr << "Usage: " << argv0
+            << " [--color_table=<path> | [--blob=<path>]\n"
+               "     [--groups=<letters>,... | --search_groups=<k>\n"
+               "      [--objective=bytes|ands]] [--permute_targets] |\n"
+               "      --previous=<blob> [--verify]]]\n";
+}
+
+int main(int argc, char** argv) {
+  std::string blob_path;
+  std::string previous_path;
+  bool verify = false;
+  bool permute_targets = false;
+  std::optional<Grouping> grouping;
+  int search_groups = 0;
+  Objective objective = Objective::kTableBytes;
+  for (int i = 1; i < argc; ++i) {
+    absl::string_view arg = argv[i];
+    if (absl::ConsumePrefix(&arg, "--color_table=")) {
+      if (!ColorTable::Build()->Write(std::string(arg))) {
+        std::cerr << "Failed to write " << arg << "\n";
+        return 1;
+      }
+      return 0;
+    } else if (absl::ConsumePrefix(&arg, "--blob=")) {
+      blob_path = std::string(arg);
+    } else if (absl::ConsumePrefix(&arg, "--groups=")) {
+      grouping.emplace();
+      if (!Grouping::Parse(arg, &*grouping)) {
+        std::cerr << "Bad letter grouping " << arg << "\n";
+        return 1;
+      }
+    } else if (absl::ConsumePrefix(&arg, "--search_groups=")) {
+      if (!absl::SimpleAtoi(arg, &search_groups) || search_groups < 2 ||
+          search_groups > raw::kMaxFactors) {
+        Usage(argv[0]);
+        return 1;
+      }
+    } else if (arg == "--objective=bytes") {
+      objective = Objective::kTableBytes;
+    } else if (arg == "--objective=ands") {
+      objective = Objective::kAndWords;
+    } else if (absl::ConsumePrefix(&arg, "--previous=")) {
+      previous_path = std::string(arg);
+    } else if (arg == "--verify") {
+      verify = true;
+    } else if (arg == "--permute_targets") {
+      permute_targets = true;
+    } else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  if (!previous_path.empty() &&
+      (grouping || search_groups != 0 || permute_targets)) {
+    std::cerr << "--previous keeps the previous letter groups and target "
+                 "order\n";
+    return 1;
+  }
+
+  Tables tables;
+  if (!previous_path.empty()) {
+    // Incremental regeneration, falling back to a full one if it can't
+    // apply.
+    std::unique_ptr<PreviousTables> prev = PreviousTables::Read(previous_path);
+    if (!prev) {
+      return 1;
+    }
+    grouping = prev->grouping();
+    if (prev->permuted()) {
+      SetTargetOrder(PermutedTargetOrder().data());
+    }
+    const absl::Time start = absl::Now();
+    if (MakeTablesIncrementally(*prev, &tables)) {
+      std::cerr << "Updated tables in " << absl::Now() - start << "\n";
+    } else {
+      std::cerr << "Regenerating all tables\n";
+      tables = MakeTables(*grouping);
+    }
+    if (verify) {
+      if (!(tables == MakeTables(*grouping))) {
+        std::cerr << "Incremental tables differ from a full regeneration\n";
+        return 1;
+      }
+      std::cerr << "Verified against a full regeneration\n";
+    }
+  } else {
+    if (permute_targets) {
+      SetTargetOrder(PermutedTargetOrder().data());
+    }
+    if (search_groups != 0) {
+      grouping = SearchGrouping(search_groups, objective);
+      std::cerr << "Using --groups=" << grouping->ToString() << "\n";
+    } else if (!grouping) {
+      grouping = DefaultGrouping();
+    }
+    tables = MakeTables(*grouping);
+  }
+  if (!FitsMaskIndices(tables)) {
+    return 1;
+  }
+  if (blob_path.empty()) {
+    EmitSource(tables);
+  } else if (!WriteBlob(tables, blob_path)) {
+    std::cerr << "Failed to write " << blob_path << "\n";
+    return 1;
+  }
+  return 0;
+}
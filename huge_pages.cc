@@ -0,0 +1,230 @@
+#include "huge_pages.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace wordle {
+
+namespace {
+
+constexpr size_t kSmallPageSize = 4096;
+
+size_t RoundUpToHugePage(size_t size) {
+  return (size + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+}
+
+// Writes a zero to every small page of [data, data + size), so the kernel
+// backs the whole range now rather than on first use.
+void FaultIn(char* data, size_t size) {
+  for (size_t i = 0; i < size; i += kSmallPageSize) {
+    data[i] = 0;
+  }
+}
+
+// Returns the number of bytes of [data, data + size) that /proc/self/smaps
+// reports as transparent huge pages, or 0 if it cannot be read.
+size_t AnonHugeBytes(const char* data, size_t size) {
+  FILE* f = fopen("/proc/self/smaps", "r");
+  if (!f) {
+    return 0;
+  }
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(data);
+  const uintptr_t end = begin + size;
+  size_t total = 0;
+  size_t overlap = 0;
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    uintptr_t vma_begin, vma_end;
+    size_t kb;
+    if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " ", &vma_begin, &vma_end) ==
+        2) {
+      overlap = vma_begin < end && begin < vma_end
+                    ? std::min(end, vma_end) - std::max(begin, vma_begin)
+                    : 0;
+    } else if (overlap > 0 &&
+               sscanf(line, "AnonHugePages: %zu kB", &kb) == 1) {
+      // Adjacent buffers can share a mapping, so this is only exact when the
+      // mapping holds nothing else.
+      total += std::min(kb * 1024, overlap);
+    }
+  }
+  fclose(f);
+  return total;
+}
+
+// Maps `size` bytes aligned to a huge page, so transparent huge pages can
+// back all of it.
+char* MapAligned(size_t size) {
+  void* addr = mmap(nullptr, size + kHugePageSize, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    return nullptr;
+  }
+  char* raw = static_cast<char*>(addr);
+  char* data = reinterpret_cast<char*>(
+      RoundUpToHugePage(reinterpret_cast<uintptr_t>(raw)));
+  if (data > raw) {
+    munmap(raw, data - raw);
+  }
+  munmap(data + size, raw + kHugePageSize - data);
+  return data;
+}
+
+struct Mapping {
+  char* data;
+  size_t huge_bytes;
+  const char* source;
+};
+
+// Maps `size` bytes, a multiple of kHugePageSize, with transparent huge pages
+// requested.  Leaves `huge_bytes` unknown (zero).
+Mapping MapTransparent(size_t size) {
+  char* data = MapAligned(size);
+  if (data != nullptr) {
+    madvise(data, size, MADV_HUGEPAGE);
+    FaultIn(data, size);
+  }
+  return {data, 0, "none"};
+}
+
+Mapping MapHugetlb(size_t size) {
+  void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (addr == MAP_FAILED) {
+    return {nullptr, 0, "none"};
+  }
+  FaultIn(static_cast<char*>(addr), size);
+  return {static_cast<char*>(addr), size, "hugetlbfs"};
+}
+
+// Maps `size` bytes, a multiple of kHugePageSize, as described for
+// HugePageBuffer.  `data` is null if nothing could be mapped.
+Mapping MapHugePages(size_t size) {
+  Mapping m = MapTransparent(size);
+  if (m.data != nullptr) {
+    m.huge_bytes = AnonHugeBytes(m.data, size);
+    if (m.huge_bytes > 0) {
+      m.source = "transparent";
+      return m;
+    }
+  }
+  Mapping fallback = MapHugetlb(size);
+  if (fallback.data == nullptr) {
+    return m;
+  }
+  if (m.data != nullptr) {
+    munmap(m.data, size);
+  }
+  return fallback;
+}
+
+}  // namespace
+
+bool HugePagesEnabled() {
+  static const bool enabled = [] {
+    const char* value = getenv("WORDLE_HUGE_PAGES");
+    return value != nullptr && *value != '\0' && strcmp(value, "0") != 0;
+  }();
+  return enabled;
+}
+
+std::unique_ptr<HugePageBuffer> HugePageBuffer::Allocate(size_t size) {
+  size = RoundUpToHugePage(std::max<size_t>(size, 1));
+  Mapping m = MapHugePages(size);
+  if (m.data == nullptr) {
+    return nullptr;
+  }
+  return std::unique_ptr<HugePageBuffer>(
+      new HugePageBuffer(m.data, size, m.huge_bytes, m.source));
+}
+
+HugePageBuffer::~HugePageBuffer() { munmap(data_, size_); }
+
+namespace {
+
+// Totals over every AllocateMaybeHuge mapping, by where its pages came from.
+std::atomic<size_t> mapped_bytes{0};
+std::atomic<size_t> hugetlb_bytes{0};
+std::atomic<size_t> transparent_bytes{0};
+
+void LogHugePageTotals() {
+  const size_t mapped = mapped_bytes.load();
+  const size_t hugetlb = hugetlb_bytes.load();
+  const size_t transparent = transparent_bytes.load();
+  fprintf(stderr,
+          "Reduced tables: %.1f MB mapped, %.1f MB from hugetlbfs, %.1f MB "
+          "with transparent huge pages, %.1f MB in small pages\n",
+          mapped / 1e6, hugetlb / 1e6, transparent / 1e6,
+          (mapped - hugetlb - transparent) / 1e6);
+}
+
+// Adds `m`, a mapping of `size` bytes, to the totals.
+void Count(const Mapping& m, size_t size) {
+  mapped_bytes += size;
+  if (strcmp(m.source, "hugetlbfs") == 0) {
+    hugetlb_bytes += size;
+  } else if (strcmp(m.source, "transparent") == 0) {
+    transparent_bytes += size;
+  }
+}
+
+}  // namespace
+
+void* AllocateMaybeHuge(size_t size) {
+  if (!HugePagesEnabled() || size < kHugePageSize / 2) {
+    return ::operator new(size);
+  }
+  size = RoundUpToHugePage(size);
+  // Reading smaps is slow, so only the first allocation checks which kind of
+  // huge page the kernel hands out, keeping the mapping it checked.  Later
+  // ones go straight to that kind, and are assumed to get what it got.
+  Mapping probe = {nullptr, 0, "none"};
+  static const char* const kind = [&probe, size] {
+    probe = MapHugePages(size);
+    fprintf(stderr, "Reduced tables: %.1f of %.1f MB in huge pages (%s)\n",
+            probe.huge_bytes / 1e6, size / 1e6, probe.source);
+    atexit(LogHugePageTotals);
+    return probe.huge_bytes > 0 ? probe.source : "none";
+  }();
+  Mapping m = probe;
+  if (m.data == nullptr && strcmp(kind, "hugetlbfs") == 0) {
+    m = MapHugetlb(size);
+    if (m.data == nullptr) {
+      static std::atomic<bool> logged{false};
+      if (!logged.exchange(true)) {
+        fprintf(stderr,
+                "Reduced tables: the hugetlbfs pool ran out after %.1f MB; "
+                "the rest are in small pages\n",
+                hugetlb_bytes.load() / 1e6);
+      }
+    }
+  }
+  if (m.data == nullptr) {
+    m = MapTransparent(size);
+    if (strcmp(kind, "transparent") == 0) {
+      m.source = kind;
+    }
+  }
+  if (m.data == nullptr) {
+    throw std::bad_alloc();
+  }
+  Count(m, size);
+  return m.data;
+}
+
+void FreeMaybeHuge(void* ptr, size_t size) {
+  if (!HugePagesEnabled() || size < kHugePageSize / 2) {
+    ::operator delete(ptr);
+    return;
+  }
+  munmap(ptr, RoundUpToHugePage(size));
+}
+
+}  // namespace wordle
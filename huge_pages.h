@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+namespace wordle {
+
+constexpr size_t kHugePageSize = size_t{2} << 20;
+
+// Returns true if $WORDLE_HUGE_PAGES is set to anything but "" or "0".  The
+// raw tables and large reduced tables then live in huge pages, which saves
+// most of the dTLB misses of many threads walking them at random.
+bool HugePagesEnabled();
+
+// Anonymous memory, rounded up to whole huge pages, that the kernel is asked
+// to back with huge pages: transparent ones (madvise(MADV_HUGEPAGE)) first,
+// then the hugetlbfs pool (MAP_HUGETLB) if no transparent ones were handed
+// out.  Failing both it is ordinary memory.  The memory is zeroed and faulted
+// in by Allocate.
+class HugePageBuffer {
+ public:
+  // Returns nullptr if no memory could be mapped.
+  static std::unique_ptr<HugePageBuffer> Allocate(size_t size);
+
+  HugePageBuffer(const HugePageBuffer&) = delete;
+  HugePageBuffer& operator=(const HugePageBuffer&) = delete;
+  ~HugePageBuffer();
+
+  char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+  // How much of the buffer the kernel backed with huge pages, and how:
+  // "transparent", "hugetlbfs" or "none".
+  size_t huge_bytes() const { return huge_bytes_; }
+  const char* source() const { return source_; }
+
+ private:
+  HugePageBuffer(char* data, size_t size, size_t huge_bytes,
+                 const char* source)
+      : data_(data), size_(size), huge_bytes_(huge_bytes), source_(source) {}
+
+  char* data_;
+  size_t size_;
+  size_t huge_bytes_;
+  const char* source_;
+};
+
+// Backing for HugePageAllocator.  Allocations of at least half a huge page
+// are mapped as for HugePageBuffer when HugePagesEnabled(), and the rest go to
+// operator new.  The first huge-page allocation logs how much of it the
+// kernel backed with huge pages.  Every one is counted by where its pages
+// came from, and the totals are logged at exit, along with any fallback from
+// hugetlbfs to transparent huge pages when it happens.
+void* AllocateMaybeHuge(size_t size);
+void FreeMaybeHuge(void* ptr, size_t size);
+
+// A std::allocator replacement that places large arrays in huge pages; see
+// AllocateMaybeHuge.
+template <typename T>
+struct HugePageAllocator {
+  using value_type = T;
+
+  HugePageAllocator() = default;
+  template <typename U>
+  HugePageAllocator(const HugePageAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+    return static_cast<T*>(AllocateMaybeHuge(n * sizeof(T)));
+  }
+  void deallocate(T* ptr, size_t n) { FreeMaybeHuge(ptr, n * sizeof(T)); }
+
+  template <typename U>
+  bool operator==(const HugePageAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const HugePageAllocator<U>&) const {
+    return false;
+  }
+};
+
+}  // namespace wordle
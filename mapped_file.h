@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace wordle {
+
+// A read-only memory mapping of an entire file.
+class MappedFile {
+ public:
+  // Maps the file at `path`.  Returns nullptr if the file cannot be opened or
+  // mapped.
+  static std::unique_ptr<MappedFile> Open(const std::string& path);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  ~MappedFile();
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  MappedFile(const char* data, size_t size) : data_(data), size_(size) {}
+
+  const char* data_;
+  size_t size_;
+};
+
+}  // namespace wordle
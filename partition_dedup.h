@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace wordle {
+
+// Finds guesses with the same partition by hashing rather than by sorting
+// every partition first.  Each guess's fingerprint is the sum of a hash of
+// each of its branches (see HashBranch), so it can be added up as the
+// branches are generated, before they are sorted.  Guesses whose
+// fingerprints match are compared exactly, so a collision only costs a
+// comparison.  Reused from one call to the next.
+class PartitionDedup {
+ public:
+  // Mixes the bits identifying one branch into a value to add to its
+  // guess's fingerprint.
+  static uint64_t HashBranch(uint64_t branch) {
+    branch ^= branch >> 33;
+    branch *= 0xff51afd7ed558ccdULL;
+    branch ^= branch >> 33;
+    branch *= 0xc4ceb9fe1a85ec53ULL;
+    return branch ^ (branch >> 33);
+  }
+
+  // Forgets the guesses seen so far, making room for `n` more.
+  void Reset(int n) {
+    size_t size = 16;
+    while (size < 2 * size_t(n)) size *= 2;
+    slots_.assign(size, {0, -1});
+  }
+
+  // Returns true if a guess seen since Reset() has fingerprint
+  // `fingerprint` and `eq(that guess, g)`.  Otherwise records `g` and
+  // returns false, so of each set of equal guesses only the first seen is
+  // reported new.
+  template <typename Eq>
+  bool Seen(uint64_t fingerprint, int g, Eq eq) {
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = fingerprint & mask;; i = (i + 1) & mask) {
+      auto& [slot_fingerprint, slot_g] = slots_[i];
+      if (slot_g < 0) {
+        slots_[i] = {fingerprint, g};
+        return false;
+      }
+      if (slot_fingerprint == fingerprint && eq(slot_g, g)) {
+        return true;
+      }
+    }
+  }
+
+ private:
+  // Fingerprint and guess, or -1 for an empty slot.
+  std::vector<std::pair<uint64_t, int>> slots_;
+};
+
+// The live guesses of a state: those that split it, less those found to
+// partition it the same as an earlier guess.  Every guess not live leaves
+// each substate of the state in one piece, or partitions it the same as a
+// live guess, so a substate need only be partitioned by the live ones.
+// Reused from one state to the next.
+class LiveGuesses {
+ public:
+  void Clear() {
+    live_.clear();
+    removed_.clear();
+  }
+
+  // Adds guess `g`, which must be greater than every guess added since
+  // Clear().
+  void Add(int g) { live_.push_back(g); }
+
+  // Removes guess `g`, found to be a duplicate.
+  void Remove(int g) { removed_.push_back(g); }
+
+  // The guesses added and not removed, in increasing order.  Valid until
+  // the next change.
+  absl::Span<const int> Get() {
+    if (!removed_.empty()) {
+      std::sort(removed_.begin(), removed_.end());
+      auto removed = removed_.begin();
+      int kept = 0;
+      for (int g : live_) {
+        while (removed != removed_.end() && *removed < g) {
+          ++removed;
+        }
+        if (removed == removed_.end() || *removed != g) {
+          live_[kept++] = g;
+        }
+      }
+      live_.resize(kept);
+      removed_.clear();
+    }
+    return live_;
+  }
+
+ private:
+  std::vector<int> live_;
+  // Removed guesses, taken out of live_ by the next Get().
+  std::vector<int> removed_;
+};
+
+}  // namespace wordle
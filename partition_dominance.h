@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "color_guess.h"
+
+namespace wordle {
+
+// Finds guesses that can score no better than a guess already kept, because
+// the kept guess's partition of the state refines theirs: each of its
+// branches lies within one of theirs.  Knowing which of their branches a
+// target is in tells a player no more than knowing which of the kept guess's
+// branches it is in, so every branch of theirs costs at least as much as the
+// branches of the kept guess within it.  (A target the kept guess solves is
+// in none of its branches; one the other guess solves must be solved by the
+// kept guess too, or it would cost the kept guess a guess more.)
+//
+// The check compares colors, so guesses can be dropped before any branch is
+// built.  Refinement survives restriction to any subset of the state, so a
+// dominated guess is also dominated in every substate.
+//
+// A refinement always has a lower bound than the partitions it refines, so
+// the streams check their guesses in order of their bounds, each against the
+// first few guesses kept, which have the most and smallest branches.  Most
+// guesses are not dominated, and each check reads colors until the first
+// target that rules it out, so the reads are capped at an average per guess
+// checked.  Reused from one state to the next.
+class DominanceFilter {
+ public:
+  // The most kept guesses a guess is checked against.
+  static constexpr int kMaxChecksPerGuess = 8;
+  // The most target colors read per guess to be checked.
+  static constexpr int kBudgetPerGuess = 128;
+
+  // Starts on a state with these indices of targets, with no guesses kept,
+  // to check up to `num_guesses` guesses.  `targets` must stay valid until
+  // the next Reset().
+  void Reset(absl::Span<const uint16_t> targets, int num_guesses) {
+    targets_ = targets;
+    kept_.clear();
+    budget_ = int64_t{kBudgetPerGuess} * num_guesses;
+    num_dominated_ = 0;
+  }
+
+  // Returns true if a guess kept since Reset() partitions the state at least
+  // as finely as `guess`, checking as many as the budget allows.
+  bool Dominated(Word guess) {
+    const uint8_t* row = ColorTable::Get().Row(guess);
+    for (int i = 0; i < int(kept_.size()) && budget_ > 0; ++i) {
+      if (Refines(kept_[i], row)) {
+        ++num_dominated_;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Records that `guess` was kept, to check later guesses against.
+  void Keep(Word guess) {
+    if (kept_.size() < kMaxChecksPerGuess) {
+      kept_.push_back(ColorTable::Get().Row(guess));
+    }
+  }
+
+  // The number of guesses Dominated() has found since Reset().
+  int num_dominated() const { return num_dominated_; }
+
+ private:
+  // The last code is all green: the guess solves that target.
+  static constexpr uint8_t kSolved = kNumColorCodes - 1;
+  static constexpr uint8_t kUnseen = 0xff;
+
+  // Returns whether the guess with colors `fine` refines the one with colors
+  // `coarse`: whether the targets `fine` does not solve, grouped by their
+  // `fine` colors, share `coarse` colors within each group, none of them
+  // solved by `coarse`.
+  bool Refines(const uint8_t* fine, const uint8_t* coarse) {
+    uint8_t coarse_of[kNumColorCodes];
+    std::memset(coarse_of, kUnseen, sizeof(coarse_of));
+    int read = 0;
+    bool refines = true;
+    for (uint16_t target : targets_) {
+      ++read;
+      const uint8_t f = fine[target];
+      if (f == kSolved) continue;
+      const uint8_t c = coarse[target];
+      if (c == kSolved || (coarse_of[f] != kUnseen && coarse_of[f] != c)) {
+        refines = false;
+        break;
+      }
+      coarse_of[f] = c;
+    }
+    budget_ -= read;
+    return refines;
+  }
+
+  absl::Span<const uint16_t> targets_;
+  // The color rows of the first guesses kept.
+  std::vector<const uint8_t*> kept_;
+  int64_t budget_ = 0;
+  int num_dominated_ = 0;
+};
+
+}  // namespace wordle
@@ -1,36 +1,49 @@
 #include "partition_map.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <numeric>
+#include <thread>
+#include <utility>
+
 #include "raw_data.h"
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/numeric/bits.h"
 
 namespace wordle {
 
+int sparse_partition_cutoff = 400;
+
 namespace {
 
+// Orders branches by StateId alone, which spares the sort State's comparison
+// of the words of branches with equal ids; most such branches are equal.
+// Distinct partitions that tie are left next to each other, and PartitionEq,
+// which is exact, keeps them both.
 template <typename MaskType>
 struct BranchCmp {
   bool operator()(const Branch<MaskType>& lhs,
                   const Branch<MaskType>& rhs) const {
-    return lhs.mask < rhs.mask;
+    return lhs.mask.ToStateId() < rhs.mask.ToStateId();
   }
 };
 
 template <typename MaskType>
 struct PartitionCmp {
-  bool operator()(const Partition<MaskType>& lhs,
-                  const Partition<MaskType>& rhs) const {
-    return std::lexicographical_compare(
-        lhs.branches.begin(), lhs.branches.end(), rhs.branches.begin(),
-        rhs.branches.end(), BranchCmp<MaskType>{});
+  bool operator()(absl::Span<const Branch<MaskType>> lb,
+                  absl::Span<const Branch<MaskType>> rb) const {
+    return std::lexicographical_compare(lb.begin(), lb.end(), rb.begin(),
+                                        rb.end(), BranchCmp<MaskType>{});
   }
 };
 
 template <typename MaskType>
 struct PartitionEq {
-  bool operator()(const Partition<MaskType>& lhs,
-                  const Partition<MaskType>& rhs) const {
-    const auto& lb = lhs.branches;
-    const auto& rb = rhs.branches;
+  bool operator()(absl::Span<const Branch<MaskType>> lb,
+                  absl::Span<const Branch<MaskType>> rb) const {
     return lb.size() == rb.size() &&
            std::equal(
                lb.begin(), lb.end(), rb.begin(),
@@ -38,40 +51,732 @@ struct PartitionEq {
   }
 };
 
-void SortPartition(FullPartition& p) {
-  std::sort(p.branches.begin(), p.branches.end(), BranchCmp<State>{});
-  std::reverse(p.branches.begin(), p.branches.end());
+// Sets `order` to the guesses in [0, fingerprints.size()) whose partition no
+// earlier guess has, sorted by PartitionCmp.  `branches(g)` returns the
+// branches of guess `g`, largest first, and `fingerprints[g]` is the sum of
+// PartitionDedup::HashBranch over them.  Duplicates are found by hashing, so
+// only the distinct partitions are sorted, and the sort compares the ids of
+// their largest branches, reading the rest only on ties.
+template <typename MaskType, typename BranchesFn>
+void DedupAndSort(const std::vector<uint64_t>& fingerprints,
+                  BranchesFn branches, PartitionDedup& dedup,
+                  std::vector<std::pair<StateId, int>>& keys,
+                  std::vector<int>& order) {
+  const int num_guesses = fingerprints.size();
+  dedup.Reset(num_guesses);
+  keys.clear();
+  for (int g = 0; g < num_guesses; ++g) {
+    if (!dedup.Seen(fingerprints[g], g, [&](int lhs, int rhs) {
+          return PartitionEq<MaskType>{}(branches(lhs), branches(rhs));
+        })) {
+      keys.emplace_back(branches(g)[0].mask.ToStateId(), g);
+    }
+  }
+  std::sort(keys.begin(), keys.end(), [&](const auto& lhs, const auto& rhs) {
+    if (lhs.first != rhs.first) return lhs.first < rhs.first;
+    return PartitionCmp<MaskType>{}(branches(lhs.second),
+                                    branches(rhs.second));
+  });
+  order.clear();
+  for (const auto& [id, g] : keys) {
+    order.push_back(g);
+  }
 }
 
-void SortPartitions(std::vector<FullPartition>& ps) {
-  for (FullPartition& p : ps) {
-    SortPartition(p);
+// Fills `scratch` with the branches of `guess` from `in` that are neither
+// empty nor all of `in`, and `keys` with their ids and positions in `scratch`,
+// largest first.  States are too big to swap around cheaply, so callers move
+// each branch once in key order instead of sorting the branches.
+// `products` was Reset() on `in`; only the words of each branch's product
+// are read.  Branches with fewer than `min_count` targets are left out too.
+template <int num_factors>
+void CollectBranches(const State& in, FactorProducts& products,
+                     const raw::Guess& guess,
+                     std::vector<FullBranch>& scratch,
+                     std::vector<std::pair<StateId, int>>& keys,
+                     int min_count = 1) {
+  scratch.clear();
+  keys.clear();
+  for (const raw::Indices& branch : guess.branches) {
+    // No branch holds more of `in` than of the initial state, so the rest
+    // are too small.
+    if (branch.bit_count < min_count) break;
+    CompactMask masks[num_factors];
+    int product_count;
+    masks[0] = products.Get(branch.mask_index[0], &product_count);
+    if (product_count == 0) continue;
+    for (int f = 1; f < num_factors; ++f) {
+      masks[f] = branch.CompactFactorMask(f);
+    }
+    State mix(in, masks, num_factors, masks[0].present);
+    int c = mix.count();
+    if (c >= min_count && c != in.count()) {
+      keys.emplace_back(mix.ToStateId(), scratch.size());
+      scratch.push_back({branch.colors, std::move(mix)});
+    }
   }
-  std::sort(ps.begin(), ps.end(), PartitionCmp<State>{});
+  std::sort(keys.begin(), keys.end(), std::greater<>());
 }
 
 }  // namespace
 
-std::vector<FullPartition> SubPartitions(const State& in) {
-  std::vector<FullPartition> result;
+void FactorProducts::Reset(const State& in) {
+  in_ = &in;
+  in_nonzero_ = in.NonzeroWords();
+  if (++generation_ == 0) {
+    products_.assign(products_.size(), Product());
+    generation_ = 1;
+  }
+  products_.resize(raw::compact_factor_masks[0].headers.size());
+  words_.clear();
+}
+
+CompactMask FactorProducts::Get(int index, int* count) {
+  Product& product = products_[index];
+  if (product.generation != generation_) {
+    const CompactMask mask = raw::compact_factor_masks[0][index];
+    product = {0, uint32_t(words_.size()), 0, generation_};
+    uint64_t present = in_nonzero_ & mask.present;
+    while (present) {
+      const int i = absl::countr_zero(present);
+      const uint64_t below = (uint64_t{1} << i) - 1;
+      present &= present - 1;
+      const uint64_t word =
+          in_->array()[i] & mask.words[absl::popcount(mask.present & below)];
+      if (word != 0) {
+        words_.push_back(word);
+        product.present |= uint64_t{1} << i;
+        product.count += absl::popcount(word);
+      }
+    }
+  }
+  *count = product.count;
+  return {product.present, words_.data() + product.offset};
+}
+
+namespace {
+
+// Lists the targets of `in` in `sparse` if it has few enough of them to be
+// partitioned in sparse form, and returns whether it does.
+bool ListSparseTargets(const State& in, SparseTargets& sparse) {
+  if (in.count() > sparse_partition_cutoff) return false;
+  sparse.state.Assign(in);
+  sparse.targets.clear();
+  for (uint16_t bit : sparse.state.bits()) {
+    sparse.targets.push_back(TargetAtBit(bit).ToIndex());
+  }
+  sparse.codes.resize(in.count());
+  sparse.grouped.resize(in.count());
+  return true;
+}
+
+// Sets `targets` to the indices of the targets of `in`.
+void ListTargets(const State& in, std::vector<uint16_t>& targets) {
+  targets.clear();
+  for (int i = 0; i < State::kNumWords; ++i) {
+    for (uint64_t word = in.array()[i]; word != 0; word &= word - 1) {
+      targets.push_back(
+          TargetAtBit(64 * i + absl::countr_zero(word)).ToIndex());
+    }
+  }
+}
+
+// As CollectBranches, for the state listed in `sparse`: its targets are
+// sorted by their colors against `guess`, and each run becomes a branch.
+// Only nonempty branches are built, and nothing is read from the mask tables.
+void CollectSparseBranches(const raw::Guess& guess, SparseTargets& sparse,
+                           std::vector<FullBranch>& scratch,
+                           std::vector<std::pair<StateId, int>>& keys,
+                           int min_count = 1) {
+  scratch.clear();
+  keys.clear();
+  const absl::Span<const uint16_t> bits = sparse.state.bits();
+  const int n = bits.size();
+  const uint8_t* row = ColorTable::Get().Row(guess.word);
+  // Counts per color, then the end of each color's run, then (after placing
+  // the bits last to first, which keeps each run in increasing order) its
+  // beginning.
+  int run[kNumColorCodes + 1] = {};
+  for (int i = 0; i < n; ++i) {
+    const uint8_t code = row[sparse.targets[i]];
+    sparse.codes[i] = code;
+    ++run[code];
+  }
+  for (int c = 1; c < kNumColorCodes; ++c) {
+    run[c] += run[c - 1];
+  }
+  run[kNumColorCodes] = n;
+  for (int i = n - 1; i >= 0; --i) {
+    sparse.grouped[--run[sparse.codes[i]]] = bits[i];
+  }
+  // The last code is all green, which only the guess itself gets.  Guessing
+  // the answer ends the game, so the tables have no branch for it.
+  for (int c = 0; c < kNumColorCodes - 1; ++c) {
+    const int size = run[c + 1] - run[c];
+    if (size < min_count || size == n) continue;
+    State mix(absl::MakeConstSpan(sparse.grouped.data() + run[c], size));
+    keys.emplace_back(mix.ToStateId(), scratch.size());
+    scratch.push_back({Colors::FromCode(c), std::move(mix)});
+  }
+  std::sort(keys.begin(), keys.end(), std::greater<>());
+}
+
+// The bodies of SubPartitions, with the number of factor tables fixed at
+// compile time so the per-branch loops unroll.
+template <int num_factors>
+std::vector<FullPartition> SubPartitionsImpl(const State& in) {
+  std::vector<FullPartition> partitions;
+  std::vector<uint64_t> fingerprints;
+  std::vector<FullBranch> scratch;
+  std::vector<std::pair<StateId, int>> keys;
+  SparseTargets sparse;
+  FactorProducts products;
+  const bool use_sparse = ListSparseTargets(in, sparse);
+  if (!use_sparse) products.Reset(in);
   for (const raw::Guess& guess : raw::guesses) {
-    FullPartition filtered;
+    if (use_sparse) {
+      CollectSparseBranches(guess, sparse, scratch, keys);
+    } else {
+      CollectBranches<num_factors>(in, products, guess, scratch, keys);
+    }
+    if (keys.empty()) continue;
+    FullPartition& filtered = partitions.emplace_back();
     filtered.word = guess.word;
-    for (const raw::Indices& branch : guess.branches) {
-      State mix(in, branch.Mask1(), branch.Mask2());
-      int c = mix.count();
-      if (c > 0 && c != in.count()) {
-        filtered.branches.push_back({branch.colors, std::move(mix)});
+    filtered.branches.reserve(keys.size());
+    uint64_t fingerprint = 0;
+    for (const auto& [id, i] : keys) {
+      fingerprint += PartitionDedup::HashBranch(uint64_t(id));
+      filtered.branches.push_back(std::move(scratch[i]));
+    }
+    fingerprints.push_back(fingerprint);
+  }
+  PartitionDedup dedup;
+  std::vector<int> order;
+  DedupAndSort<State>(
+      fingerprints,
+      [&](int g) { return absl::MakeConstSpan(partitions[g].branches); },
+      dedup, keys, order);
+  std::vector<FullPartition> result;
+  result.reserve(order.size());
+  for (int g : order) {
+    result.push_back(std::move(partitions[g]));
+  }
+  return result;
+}
+
+// Returns the number of targets in `branch` of the state `products` was
+// Reset() on, reading only the words of the branch's product present in its
+// other factor masks.  Unlike building the branch, this stores no words and
+// computes no fingerprint.
+template <int num_factors>
+int CountBranch(FactorProducts& products, const raw::Indices& branch) {
+  int count;
+  const CompactMask product = products.Get(branch.mask_index[0], &count);
+  if (num_factors == 1 || count == 0) return count;
+  CompactMask masks[num_factors];
+  uint64_t present = product.present;
+  for (int f = 1; f < num_factors; ++f) {
+    masks[f] = branch.CompactFactorMask(f);
+    present &= masks[f].present;
+  }
+  count = 0;
+  while (present) {
+    const int i = absl::countr_zero(present);
+    const uint64_t below = (uint64_t{1} << i) - 1;
+    present &= present - 1;
+    uint64_t word = product.words[absl::popcount(product.present & below)];
+    for (int f = 1; f < num_factors; ++f) {
+      word &= masks[f].words[absl::popcount(masks[f].present & below)];
+    }
+    count += absl::popcount(word);
+  }
+  return count;
+}
+
+// Calls `fn(k, count)` for each branch `k` of `guess` that holds some but
+// not all of the targets of `in`, with the number it holds.  `sparse` lists
+// the targets of `in` if it is to be counted in sparse form, or is null, in
+// which case `products` was Reset() on `in`.
+template <int num_factors, typename Fn>
+void ForEachBranchCount(const State& in, const SparseTargets* sparse,
+                        FactorProducts& products, const raw::Guess& guess,
+                        Fn fn) {
+  // For a sparse state, the size of every branch at once, from the colors of
+  // its targets.
+  int counts[kNumColorCodes] = {};
+  if (sparse != nullptr) {
+    const uint8_t* row = ColorTable::Get().Row(guess.word);
+    for (int target : sparse->targets) {
+      ++counts[row[target]];
+    }
+  }
+  for (int k = 0; k < int(guess.branches.size()); ++k) {
+    const raw::Indices& branch = guess.branches[k];
+    const int c = sparse != nullptr
+                      ? counts[branch.colors.ToCode()]
+                      : CountBranch<num_factors>(products, branch);
+    if (c > 0 && c != in.count()) {
+      fn(k, c);
+    }
+  }
+}
+
+}  // namespace
+
+template <int num_factors>
+void PartitionList::Fill(const State& in, absl::Span<const int> guesses) {
+  guesses_.clear();
+  words_.clear();
+  begin_.clear();
+  branches_.clear();
+  fingerprints_.clear();
+  states_.Clear();
+  const bool use_sparse = ListSparseTargets(in, sparse_);
+  if (!use_sparse) products_.Reset(in);
+  for (int g : guesses) {
+    const raw::Guess& guess = raw::guesses[g];
+    if (use_sparse) {
+      CollectSparseBranches(guess, sparse_, scratch_, keys_);
+    } else {
+      CollectBranches<num_factors>(in, products_, guess, scratch_, keys_);
+    }
+    if (keys_.empty()) continue;
+    guesses_.push_back(g);
+    words_.push_back(guess.word);
+    begin_.push_back(branches_.size());
+    // Most of the time interning goes to cache misses in the table, so start
+    // them all for the guess before looking any of them up.
+    for (const auto& [id, i] : keys_) {
+      states_.Prefetch(scratch_[i].mask);
+    }
+    // Interned states are equal iff their addresses are, so those identify
+    // the branches for deduplication.
+    uint64_t fingerprint = 0;
+    for (const auto& [id, i] : keys_) {
+      const InternedState mask = states_.Intern(scratch_[i].mask);
+      fingerprint += PartitionDedup::HashBranch(
+          reinterpret_cast<uintptr_t>(&*mask));
+      branches_.push_back({scratch_[i].colors, mask});
+    }
+    fingerprints_.push_back(fingerprint);
+  }
+  begin_.push_back(branches_.size());
+
+  DedupAndSort<InternedState>(
+      fingerprints_,
+      [this](int g) {
+        return absl::MakeConstSpan(branches_.data() + begin_[g],
+                                   begin_[g + 1] - begin_[g]);
+      },
+      dedup_, keys_, order_);
+  live_.clear();
+  for (int g : order_) {
+    live_.push_back(guesses_[g]);
+  }
+  std::sort(live_.begin(), live_.end());
+}
+
+template <int num_factors>
+void PartitionStream::Start(const State& in, absl::Span<const int> guesses) {
+  input_ = in;
+  use_sparse_ = ListSparseTargets(in, sparse_);
+  if (!use_sparse_) products_.Reset(input_);
+  candidates_.clear();
+  next_ = 0;
+  num_scanned_ = guesses.size();
+  live_.Clear();
+  branches_.clear();
+  begin_.assign(1, 0);
+  states_.Clear();
+  for (int g : guesses) {
+    int bound = 0;
+    bool any = false;
+    ForEachBranchCount<num_factors>(
+        in, use_sparse_ ? &sparse_ : nullptr, products_, raw::guesses[g],
+        [&](int, int c) {
+          bound += 2 * c - 1;
+          any = true;
+        });
+    if (any) {
+      candidates_.emplace_back(bound, g);
+      live_.Add(g);
+    }
+  }
+  std::sort(candidates_.begin(), candidates_.end());
+  dedup_.Reset(candidates_.size());
+  dominance_checked_ = false;
+}
+
+template <int num_factors>
+bool PartitionStream::NextImpl(Entry* entry) {
+  while (next_ < int(candidates_.size())) {
+    const auto [bound, g] = candidates_[next_++];
+    const raw::Guess& guess = raw::guesses[g];
+    if (use_sparse_) {
+      CollectSparseBranches(guess, sparse_, scratch_, keys_);
+    } else {
+      CollectBranches<num_factors>(input_, products_, guess, scratch_,
+                                   keys_);
+    }
+    uint64_t fingerprint = 0;
+    for (const auto& [id, i] : keys_) {
+      const InternedState mask = states_.Intern(scratch_[i].mask);
+      fingerprint += PartitionDedup::HashBranch(
+          reinterpret_cast<uintptr_t>(&*mask));
+      branches_.push_back({scratch_[i].colors, mask});
+    }
+    const int p = begin_.size() - 1;
+    begin_.push_back(branches_.size());
+    const bool seen = dedup_.Seen(fingerprint, p, [this](int lhs, int rhs) {
+      return PartitionEq<InternedState>{}(Branches(lhs), Branches(rhs));
+    });
+    if (seen) {
+      begin_.pop_back();
+      branches_.resize(begin_.back());
+      live_.Remove(g);
+      continue;
+    }
+    *entry = {guess.word, bound, Branches(p)};
+    return true;
+  }
+  return false;
+}
+
+bool PartitionStream::Next(Entry* entry) {
+  switch (raw::num_factors) {
+    case 1:
+      return NextImpl<1>(entry);
+    case 2:
+      return NextImpl<2>(entry);
+    case 3:
+      return NextImpl<3>(entry);
+    default:
+      return NextImpl<4>(entry);
+  }
+}
+
+absl::Span<const int> PartitionStream::live_guesses() {
+  if (!dominance_checked_) {
+    dominance_checked_ = true;
+    if (use_sparse_) {
+      dominance_.Reset(sparse_.targets, candidates_.size());
+    } else {
+      ListTargets(input_, targets_);
+      dominance_.Reset(targets_, candidates_.size());
+    }
+    // Those already produced stay in candidates_, and the rest that are
+    // dominated are dropped from it.
+    int kept = next_;
+    for (int i = 0; i < int(candidates_.size()); ++i) {
+      const int g = candidates_[i].second;
+      const Word word = raw::guesses[g].word;
+      if (dominance_.Dominated(word)) {
+        live_.Remove(g);
+      } else {
+        dominance_.Keep(word);
+        if (i >= next_) {
+          candidates_[kept++] = candidates_[i];
+        }
+      }
+    }
+    candidates_.resize(kept);
+  }
+  return live_.Get();
+}
+
+struct PartitionBatch::Worker {
+  // The inputs a worker has in hand at once.  Each guess's branches, masks
+  // and colors are read for all of them in turn.
+  static constexpr int kTileSize = 8;
+
+  // One input of the tile, with its partitions so far, as
+  // PartitionList::Fill keeps them.
+  struct Slot {
+    const State* input;
+    bool use_sparse;
+    SparseTargets sparse;
+    FactorProducts products;
+    std::vector<Word> words;
+    std::vector<uint32_t> begin;
+    std::vector<InternedBranch> branches;
+    std::vector<uint64_t> fingerprints;
+  };
+
+  // Where the partitions and states of input `input` are in the worker's
+  // arrays.
+  struct Placement {
+    int input;
+    uint32_t partition_begin;
+    uint32_t partition_end;
+    uint32_t state_begin;
+    uint32_t state_end;
+  };
+
+  void Clear() {
+    table.Clear();
+    placements.clear();
+    words.clear();
+    ranges.clear();
+    branches.clear();
+    states.clear();
+  }
+
+  // Partitions tiles of `inputs`, taking the next tile from `next_tile`
+  // until there are none left, keeping the branches with at least
+  // `min_count` targets.
+  template <int num_factors>
+  void Run(absl::Span<const State> inputs, int min_count,
+           std::atomic<int>& next_tile) {
+    this->min_count = min_count;
+    while (true) {
+      const int first = kTileSize * next_tile.fetch_add(1);
+      if (first >= int(inputs.size())) return;
+      const int n = std::min<int>(kTileSize, inputs.size() - first);
+      for (int j = 0; j < n; ++j) {
+        Start(inputs[first + j], slots[j]);
+      }
+      for (const raw::Guess& guess : raw::guesses) {
+        for (int j = 0; j < n; ++j) {
+          AddGuess<num_factors>(guess, slots[j]);
+        }
+      }
+      for (int j = 0; j < n; ++j) {
+        Finish(first + j, slots[j]);
       }
     }
-    if (!filtered.branches.empty()) {
-      result.push_back(std::move(filtered));
+  }
+
+  void Start(const State& in, Slot& slot) {
+    slot.input = &in;
+    slot.use_sparse = ListSparseTargets(in, slot.sparse);
+    if (!slot.use_sparse) slot.products.Reset(in);
+    slot.words.clear();
+    slot.begin.clear();
+    slot.branches.clear();
+    slot.fingerprints.clear();
+  }
+
+  // As PartitionList::Fill does for each guess.
+  template <int num_factors>
+  void AddGuess(const raw::Guess& guess, Slot& slot) {
+    // Every branch is smaller than the input, and none of the guess's
+    // branches from the input is larger than its largest from the initial
+    // state.
+    if (slot.input->count() <= min_count ||
+        guess.branches[0].bit_count < min_count) {
+      return;
+    }
+    if (slot.use_sparse) {
+      CollectSparseBranches(guess, slot.sparse, scratch, keys, min_count);
+    } else {
+      CollectBranches<num_factors>(*slot.input, slot.products, guess, scratch,
+                                   keys, min_count);
+    }
+    if (keys.empty()) return;
+    slot.words.push_back(guess.word);
+    slot.begin.push_back(slot.branches.size());
+    for (const auto& [id, i] : keys) {
+      table.Prefetch(scratch[i].mask);
     }
+    uint64_t fingerprint = 0;
+    for (const auto& [id, i] : keys) {
+      const InternedState mask = table.Intern(scratch[i].mask);
+      fingerprint +=
+          PartitionDedup::HashBranch(reinterpret_cast<uintptr_t>(&*mask));
+      slot.branches.push_back({scratch[i].colors, mask});
+    }
+    slot.fingerprints.push_back(fingerprint);
   }
-  SortPartitions(result);
-  result.erase(std::unique(result.begin(), result.end(), PartitionEq<State>{}),
-               result.end());
-  return result;
+
+  // Deduplicates and sorts the partitions of input `input`, held in `slot`,
+  // and appends them and its distinct states to the worker's arrays.
+  void Finish(int input, Slot& slot) {
+    slot.begin.push_back(slot.branches.size());
+    DedupAndSort<InternedState>(
+        slot.fingerprints,
+        [&slot](int g) {
+          return absl::MakeConstSpan(slot.branches.data() + slot.begin[g],
+                                     slot.begin[g + 1] - slot.begin[g]);
+        },
+        dedup, keys, order);
+    Placement& placement = placements.emplace_back();
+    placement.input = input;
+    placement.partition_begin = words.size();
+    placement.state_begin = states.size();
+    seen.clear();
+    for (int g : order) {
+      words.push_back(slot.words[g]);
+      ranges.emplace_back(branches.size(),
+                          branches.size() + slot.begin[g + 1] - slot.begin[g]);
+      for (uint32_t b = slot.begin[g]; b < slot.begin[g + 1]; ++b) {
+        const InternedState mask = slot.branches[b].mask;
+        branches.push_back({slot.branches[b].colors, mask});
+        // Interned states are equal iff their addresses are.
+        if (seen.insert(&*mask).second) {
+          states.push_back(mask);
+        }
+      }
+    }
+    placement.partition_end = words.size();
+    placement.state_end = states.size();
+  }
+
+  int min_count = 1;
+  StateTable table;
+  Slot slots[kTileSize];
+
+  // The results of the inputs this worker took, in the order it took them.
+  // Partition p's branches are branches[ranges[p].first, ranges[p].second).
+  std::vector<Placement> placements;
+  std::vector<Word> words;
+  std::vector<std::pair<uint32_t, uint32_t>> ranges;
+  std::vector<InternedBranch> branches;
+  std::vector<InternedState> states;
+
+  // Scratch space for building one guess's branches and sorting an input's
+  // partitions.
+  std::vector<FullBranch> scratch;
+  std::vector<std::pair<StateId, int>> keys;
+  std::vector<int> order;
+  PartitionDedup dedup;
+  absl::flat_hash_set<const State*> seen;
 };
 
-}  // namespace wordle
\ No newline at end of file
+PartitionBatch::PartitionBatch() : input_begin_(1, 0), state_begin_(1, 0) {}
+
+PartitionBatch::~PartitionBatch() = default;
+
+absl::Span<const int> AllGuesses() {
+  static const std::vector<int>* const all = [] {
+    auto* all = new std::vector<int>(raw::guesses.size());
+    std::iota(all->begin(), all->end(), 0);
+    return all;
+  }();
+  return *all;
+}
+
+void StreamPartitions(const State& in, PartitionStream* out) {
+  StreamPartitions(in, AllGuesses(), out);
+}
+
+void StreamPartitions(const State& in, absl::Span<const int> guesses,
+                      PartitionStream* out) {
+  switch (raw::num_factors) {
+    case 1:
+      return out->Start<1>(in, guesses);
+    case 2:
+      return out->Start<2>(in, guesses);
+    case 3:
+      return out->Start<3>(in, guesses);
+    default:
+      return out->Start<4>(in, guesses);
+  }
+}
+
+std::vector<FullPartition> SubPartitions(const State& in) {
+  switch (raw::num_factors) {
+    case 1:
+      return SubPartitionsImpl<1>(in);
+    case 2:
+      return SubPartitionsImpl<2>(in);
+    case 3:
+      return SubPartitionsImpl<3>(in);
+    default:
+      return SubPartitionsImpl<4>(in);
+  }
+}
+
+void SubPartitions(const State& in, PartitionList* out) {
+  SubPartitions(in, AllGuesses(), out);
+}
+
+void SubPartitions(const State& in, absl::Span<const int> guesses,
+                   PartitionList* out) {
+  switch (raw::num_factors) {
+    case 1:
+      return out->Fill<1>(in, guesses);
+    case 2:
+      return out->Fill<2>(in, guesses);
+    case 3:
+      return out->Fill<3>(in, guesses);
+    default:
+      return out->Fill<4>(in, guesses);
+  }
+}
+
+void SubPartitionsBatch(absl::Span<const State> inputs, int num_threads,
+                        PartitionBatch* out) {
+  SubPartitionsBatch(inputs, 1, num_threads, out);
+}
+
+void SubPartitionsBatch(absl::Span<const State> inputs, int min_count,
+                        int num_threads, PartitionBatch* out) {
+  const int num_tiles =
+      (inputs.size() + PartitionBatch::Worker::kTileSize - 1) /
+      PartitionBatch::Worker::kTileSize;
+  num_threads = std::max(1, std::min(num_threads, num_tiles));
+  while (int(out->workers_.size()) < num_threads) {
+    out->workers_.push_back(std::make_unique<PartitionBatch::Worker>());
+  }
+  std::atomic<int> next_tile{0};
+  auto run = [&](PartitionBatch::Worker* worker) {
+    worker->Clear();
+    switch (raw::num_factors) {
+      case 1:
+        return worker->Run<1>(inputs, min_count, next_tile);
+      case 2:
+        return worker->Run<2>(inputs, min_count, next_tile);
+      case 3:
+        return worker->Run<3>(inputs, min_count, next_tile);
+      default:
+        return worker->Run<4>(inputs, min_count, next_tile);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; ++t) {
+    threads.emplace_back(run, out->workers_[t].get());
+  }
+  run(out->workers_[0].get());
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  // Gather the workers' results in input order.
+  std::vector<const PartitionBatch::Worker::Placement*> placements(
+      inputs.size());
+  std::vector<const PartitionBatch::Worker*> owners(inputs.size());
+  for (int t = 0; t < num_threads; ++t) {
+    for (const auto& placement : out->workers_[t]->placements) {
+      placements[placement.input] = &placement;
+      owners[placement.input] = out->workers_[t].get();
+    }
+  }
+  out->input_begin_.assign(1, 0);
+  out->state_begin_.assign(1, 0);
+  out->words_.clear();
+  out->begin_.clear();
+  out->branches_.clear();
+  out->states_.clear();
+  for (int i = 0; i < int(inputs.size()); ++i) {
+    const PartitionBatch::Worker& worker = *owners[i];
+    const PartitionBatch::Worker::Placement& placement = *placements[i];
+    for (uint32_t p = placement.partition_begin; p < placement.partition_end;
+         ++p) {
+      out->words_.push_back(worker.words[p]);
+      out->begin_.push_back(out->branches_.size());
+      const auto [begin, end] = worker.ranges[p];
+      for (uint32_t b = begin; b < end; ++b) {
+        out->branches_.push_back(
+            {worker.branches[b].colors, worker.branches[b].mask});
+      }
+    }
+    out->states_.insert(out->states_.end(),
+                        worker.states.begin() + placement.state_begin,
+                        worker.states.begin() + placement.state_end);
+    out->input_begin_.push_back(out->words_.size());
+    out->state_begin_.push_back(out->states_.size());
+  }
+  out->begin_.push_back(out->branches_.size());
+}
+
+}  // namespace wordle
@@ -1,10 +1,18 @@
 #pragma once
 
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
 #include <vector>
 
 #include "absl/strings/str_format.h"
+#include "absl/types/span.h"
 #include "color_guess.h"
+#include "partition_dedup.h"
+#include "partition_dominance.h"
 #include "state.h"
+#include "state_table.h"
 
 namespace wordle {
 
@@ -35,7 +43,311 @@ struct Partition {
 
 using FullPartition = Partition<State>;
 using FullBranch = Branch<State>;
+using InternedBranch = Branch<InternedState>;
 
+// SubPartitions builds the branches of a state with at most this many targets
+// by grouping its targets by their colors against each guess (see
+// SparseState), and those of larger states by ANDing each branch's masks with
+// the state.  Both give the same partitions; this only picks the faster.
+extern int sparse_partition_cutoff;
+
+// The targets of a state being partitioned in sparse form, with scratch
+// space for grouping them.  Reused from one call to the next.
+struct SparseTargets {
+  SparseState state;
+  // The index of the target at each of state's bits.
+  std::vector<uint16_t> targets;
+  std::vector<uint8_t> codes;
+  std::vector<uint16_t> grouped;
+};
+
+// The products of a state being partitioned in dense form with the masks of
+// the first factor table, each computed the first time a branch asks for it
+// and shared by the rest: the root's 1.1 million branches use under 14000
+// such masks.  A branch's targets are then its product ANDed with its other
+// factors, over only the words the product has left, and an empty product
+// rules out every branch that shares it without reading their other
+// factors.  Reused from one state to the next.
+class FactorProducts {
+ public:
+  // Starts on `in`, forgetting the products of the last state.  `in` must
+  // stay valid until the next Reset().
+  void Reset(const State& in);
+
+  // Returns the product of the state with mask `index` of the first factor
+  // table, holding only its nonzero words, and sets `*count` to the number
+  // of targets in it.  Valid until the next call.
+  CompactMask Get(int index, int* count);
+
+ private:
+  // A product is computed for the current state iff its generation is
+  // generation_, so Reset() forgets them all at once.  Its words are
+  // words_[offset, offset + popcount(present)).
+  struct Product {
+    uint64_t present = 0;
+    uint32_t offset = 0;
+    uint16_t count = 0;
+    uint16_t generation = 0;
+  };
+
+  const State* in_ = nullptr;
+  uint64_t in_nonzero_ = 0;
+  uint16_t generation_ = 0;
+  std::vector<Product> products_;
+  std::vector<uint64_t> words_;
+};
+
+// The partitions of a state in flat form: the branches of every guess in one
+// array, with each guess's range recorded by offset.  Branch masks are
+// interned in the list's StateTable, so each distinct state is stored once
+// however many guesses lead to it, and they stay valid until the list is
+// refilled.  Refilling a list reuses its buffers, so once they have grown to
+// fit, SubPartitions into a list does no heap allocation.
+class PartitionList {
+ public:
+  struct Entry {
+    Word word;
+    absl::Span<const InternedBranch> branches;
+  };
+
+  int size() const { return order_.size(); }
+  bool empty() const { return order_.empty(); }
+
+  // The number of distinct branch masks among every guess's branches,
+  // including those of guesses dropped as duplicates.
+  int num_states() const { return states_.size(); }
+
+  // The raw::guesses indices of the guesses listed, in increasing order: the
+  // live guesses of every branch of the input; see SubPartitions.
+  absl::Span<const int> live_guesses() const { return live_; }
+
+  Entry operator[](int i) const {
+    const int g = order_[i];
+    return {words_[g], absl::MakeConstSpan(branches_.data() + begin_[g],
+                                           begin_[g + 1] - begin_[g])};
+  }
+
+ private:
+  friend void SubPartitions(const State& input,
+                            absl::Span<const int> guesses, PartitionList* out);
+
+  template <int num_factors>
+  void Fill(const State& input, absl::Span<const int> guesses);
+
+  // Per guess with any branches, in raw::guesses order.  begin_ has one more
+  // entry, the end of the last guess.
+  std::vector<int> guesses_;
+  std::vector<Word> words_;
+  std::vector<uint32_t> begin_;
+  std::vector<InternedBranch> branches_;
+  StateTable states_;
+  // Per guess, for finding duplicates; see PartitionDedup.
+  std::vector<uint64_t> fingerprints_;
+  // The guesses in result order, after removing duplicates and sorting.
+  std::vector<int> order_;
+  std::vector<int> live_;
+
+  // Scratch space for building and sorting one guess's branches.
+  std::vector<FullBranch> scratch_;
+  std::vector<std::pair<StateId, int>> keys_;
+  SparseTargets sparse_;
+  FactorProducts products_;
+  PartitionDedup dedup_;
+};
+
+// The partitions of a state one at a time, best first: in increasing order
+// of `bound`, the sum of 2 * count - 1 over their branches, which is the
+// lower bound the scorers start from (less the state's own count).  Starting
+// a stream only counts each guess's branches, without building them;
+// Next() builds a partition's branches when it is asked for, so a scorer
+// that stops once the bound reaches its limit never builds the rest.  As
+// with SubPartitions, a guess with the same partition as one already
+// produced is skipped.  Refilling a stream reuses its buffers.
+class PartitionStream {
+ public:
+  struct Entry {
+    Word word;
+    int bound;
+    absl::Span<const InternedBranch> branches;
+  };
+
+  // The bound of the next partition Next() may produce, or INT_MAX if there
+  // are none left.  Skipped duplicates can only make the next one's higher.
+  int NextBound() const {
+    return next_ < int(candidates_.size()) ? candidates_[next_].first
+                                           : std::numeric_limits<int>::max();
+  }
+
+  // Sets `*entry` to the next partition, with its branches sorted largest
+  // first, and returns true; or returns false if there are none left.  The
+  // branches are valid until the next call.
+  bool Next(Entry* entry);
+
+  // The number of guesses with any branches, and the number built so far.
+  int num_candidates() const { return candidates_.size(); }
+  int num_built() const { return next_; }
+
+  // The number of guesses the stream was started with, and the number of
+  // them live_guesses() found dominated.
+  int num_scanned() const { return num_scanned_; }
+  int num_dominated() const {
+    return dominance_checked_ ? dominance_.num_dominated() : 0;
+  }
+
+  // The raw::guesses indices of the guesses with any branches, less those
+  // found so far to duplicate another, in increasing order: the live guesses
+  // of every branch of the input; see SubPartitions.  Valid until the next
+  // call to Next().
+  //
+  // The first call also drops the guesses dominated by one with a lower
+  // bound (see DominanceFilter), from the live guesses and from those Next()
+  // has yet to produce.  That costs a pass over the guesses' colors, which
+  // only pays off for a state with substates to partition, so it waits
+  // until one asks.
+  absl::Span<const int> live_guesses();
+
+ private:
+  friend void StreamPartitions(const State& input,
+                               absl::Span<const int> guesses,
+                               PartitionStream* out);
+
+  template <int num_factors>
+  void Start(const State& input, absl::Span<const int> guesses);
+  template <int num_factors>
+  bool NextImpl(Entry* entry);
+
+  absl::Span<const InternedBranch> Branches(int p) const {
+    return absl::MakeConstSpan(branches_.data() + begin_[p],
+                               begin_[p + 1] - begin_[p]);
+  }
+
+  State input_ = State::MakeEmpty();
+  bool use_sparse_ = false;
+  // The bound and raw::guesses index of each guess with any branches, in the
+  // order they are produced.
+  std::vector<std::pair<int, int>> candidates_;
+  int next_ = 0;
+  int num_scanned_ = 0;
+  LiveGuesses live_;
+  // The partitions produced so far, kept for finding duplicates; partition
+  // p's branches are branches_[begin_[p], begin_[p + 1]).
+  std::vector<InternedBranch> branches_;
+  std::vector<uint32_t> begin_;
+  StateTable states_;
+  PartitionDedup dedup_;
+  DominanceFilter dominance_;
+  bool dominance_checked_ = false;
+  // The indices of the input's targets, for dominance_, if not in sparse_.
+  std::vector<uint16_t> targets_;
+
+  // Scratch space for building one guess's branches.
+  std::vector<FullBranch> scratch_;
+  std::vector<std::pair<StateId, int>> keys_;
+  SparseTargets sparse_;
+  FactorProducts products_;
+};
+
+// The partitions of many states at once, from SubPartitionsBatch, in flat
+// form: the partitions of every input in one array, in input order, and
+// their branches in another.  Branch masks are interned per thread that
+// built them, so each distinct one is stored once per thread however many
+// inputs lead to it, and they stay valid until the batch is refilled.
+// Refilling a batch reuses its buffers.
+class PartitionBatch {
+ public:
+  struct Entry {
+    Word word;
+    absl::Span<const InternedBranch> branches;
+  };
+
+  PartitionBatch();
+  ~PartitionBatch();
+  PartitionBatch(const PartitionBatch&) = delete;
+  PartitionBatch& operator=(const PartitionBatch&) = delete;
+
+  int num_inputs() const { return input_begin_.size() - 1; }
+
+  // The number of partitions of input `i`, and its `p`th, in the order
+  // SubPartitions lists them.
+  int size(int i) const { return input_begin_[i + 1] - input_begin_[i]; }
+  Entry at(int i, int p) const {
+    const int q = input_begin_[i] + p;
+    return {words_[q], absl::MakeConstSpan(branches_.data() + begin_[q],
+                                           begin_[q + 1] - begin_[q])};
+  }
+
+  // The distinct branch masks of input `i`, each once, in no particular
+  // order.
+  absl::Span<const InternedState> states(int i) const {
+    return absl::MakeConstSpan(states_.data() + state_begin_[i],
+                               state_begin_[i + 1] - state_begin_[i]);
+  }
+
+ private:
+  friend void SubPartitionsBatch(absl::Span<const State> inputs,
+                                 int min_count, int num_threads,
+                                 PartitionBatch* out);
+
+  // One thread's share of the inputs; see partition_map.cc.
+  struct Worker;
+
+  // Per input, and one more entry at the end: the first of its partitions
+  // and of its states.
+  std::vector<uint32_t> input_begin_;
+  std::vector<uint32_t> state_begin_;
+  // Per partition, one more entry in begin_: the end of the last.
+  std::vector<Word> words_;
+  std::vector<uint32_t> begin_;
+  std::vector<InternedBranch> branches_;
+  std::vector<InternedState> states_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+// The index of every guess in raw::guesses, in order.
+absl::Span<const int> AllGuesses();
+
+// Returns the partitions of `input` by every guess, dropping branches that
+// are empty or all of `input`, and guesses left with no branches.  Each
+// partition's branches are sorted largest first, partitions are sorted, and
+// of each set of guesses with the same branch masks only the first in
+// raw::guesses order is kept.
 std::vector<FullPartition> SubPartitions(const State& input);
 
+// As above, but into `out`, replacing its contents.
+//
+// The overload taking `guesses` partitions `input` only by the guesses with
+// those raw::guesses indices, in increasing order.  A guess that leaves a
+// state in one piece leaves each of its substates in one piece too, and two
+// guesses that partition a state the same way partition each of its
+// substates the same way; so the live guesses of a branch, those a list or
+// stream of its parent kept, give the same partitions of the branch as
+// every guess does.
+void SubPartitions(const State& input, PartitionList* out);
+void SubPartitions(const State& input, absl::Span<const int> guesses,
+                   PartitionList* out);
+
+// Sets `out` to produce the partitions of `input`, best first, by every
+// guess or by those in `guesses` as for SubPartitions.
+void StreamPartitions(const State& input, PartitionStream* out);
+void StreamPartitions(const State& input, absl::Span<const int> guesses,
+                      PartitionStream* out);
+
+// Sets `out` to the partitions of each of `inputs`, as SubPartitions into a
+// PartitionList gives them, on up to `num_threads` threads.  Rather than
+// stream every guess's branches and masks through the cache once per
+// input, each thread takes the inputs a few at a time and builds each
+// guess's branches for all of them in turn, while its masks are in cache.
+void SubPartitionsBatch(absl::Span<const State> inputs, int num_threads,
+                        PartitionBatch* out);
+
+// As above, but leaving out the branches with fewer than `min_count`
+// targets, and the guesses left with none.  Partitions are compared for
+// duplicates by the branches kept, so this can drop guesses whose
+// partitions differ only in smaller branches, but states() still has every
+// branch of each input with at least `min_count` targets.  Branches that
+// small are skipped before any mask is read, which spares most of the work
+// when `min_count` is large.
+void SubPartitionsBatch(absl::Span<const State> inputs, int min_count,
+                        int num_threads, PartitionBatch* out);
+
 }  // namespace wordle
\ No newline at end of file
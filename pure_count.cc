@@ -1,85 +1,93 @@
-#include <optional>
+#include <atomic>
 #include <string_view>
 #include <thread>
+#include <vector>
 
 #include "partition_map.h"
 #include "state.h"
 #include "score.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/numeric/int128.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 
 using namespace wordle;
 
+// The most targets among the states partitioned in one batch, which keeps
+// the batch's branch masks to a few hundred MB.
+constexpr int kBatchTargets = 4096;
+
 // low_len and high_len are inclusive
 void concoct(int num_threads, int low_len) {
-  std::set<wordle::State> all_masks;
-  int full_count = 0;
-  for (FullPartition& p : SubPartitions(wordle::State::AllBits())) {
-    full_count += p.branches.size();
-    for (FullBranch& b : p.branches) {
-      all_masks.emplace(std::move(b.mask));
-    }
-  }
-  while ((*all_masks.begin()).count() < low_len) {
-    all_masks.erase(all_masks.begin());
-  }
-
   struct LockedStates {
     absl::Mutex mu;
     absl::flat_hash_set<wordle::State> s;
   };
   std::deque<LockedStates> sm;
-  absl::flat_hash_set<uint64_t> rapidash;
+  absl::flat_hash_set<absl::uint128> fingerprints;
   sm.resize(kNumTargets + 1);
 
   sm[kNumTargets].s.insert(State::MakeAllBits());
   int counted = 0;
+  PartitionBatch batch;
 
   while (!sm.empty()) {
     if (sm.back().s.empty()) {
       sm.pop_back();
       continue;
     }
-    absl::Mutex current_items_mu;
-    absl::flat_hash_set<wordle::State> current_items = std::move(sm.back().s);
+    absl::flat_hash_set<wordle::State> current_set = std::move(sm.back().s);
     sm.pop_back();
+    std::vector<wordle::State> current_items;
+    current_items.reserve(current_set.size());
+    while (!current_set.empty()) {
+      current_items.push_back(
+          std::move(current_set.extract(current_set.begin()).value()));
+    }
+    for (const State& s : current_items) {
+      // The sets compare states exactly, so a repeated fingerprint is two
+      // states that share it.  Both are still counted.
+      auto ins = fingerprints.insert(s.Fingerprint());
+      if (!ins.second) {
+        fprintf(stderr, "\nFingerprint collision at %016lx%016lx\n",
+                absl::Uint128High64(*ins.first),
+                absl::Uint128Low64(*ins.first));
+      }
+      ++counted;
+    }
     int current_size = sm.size();
-    std::vector<std::thread> threads;
-    for (int i = 0; i < num_threads; ++i) {
-      threads.emplace_back([&]{
-        while (true) {
-          std::optional<wordle::State> s;
-          {
-            absl::MutexLock lock(&current_items_mu);
-            if (current_items.empty()) {
-              return;
-            }
-            s = std::move(current_items.extract(current_items.begin()).value());
-            auto ins = rapidash.insert(s->Rapidash());
-            if (!ins.second) {
-              printf("\n\nCollision at %lx\n\n", *ins.first);
-              exit(1);
-            }
-            ++counted;
-          }
-          for (const State& mask : all_masks) {
-            State combined = mask & *s;
-            if (combined.count() >= low_len &&
-                combined.count() < current_size) {
+    // The states each one leads to are its branches by every guess.
+    for (size_t begin = 0; begin < current_items.size();) {
+      size_t end = begin;
+      for (int targets = 0;
+           end < current_items.size() && targets < kBatchTargets; ++end) {
+        targets += current_items[end].count();
+      }
+      SubPartitionsBatch(
+          absl::MakeConstSpan(current_items).subspan(begin, end - begin),
+          low_len, num_threads, &batch);
+      std::atomic<int> next_input{0};
+      std::vector<std::thread> threads;
+      for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&]{
+          for (int input = next_input++; input < batch.num_inputs();
+               input = next_input++) {
+            for (InternedState combined : batch.states(input)) {
               absl::MutexLock lock(&sm[combined.count()].mu);
-              sm[combined.count()].s.insert(std::move(combined));
+              sm[combined.count()].s.insert(*combined);
             }
           }
-        }
-      });
-    }
-    for (int i = 0; i < num_threads; ++i) {
-      threads[i].join();
+        });
+      }
+      for (int i = 0; i < num_threads; ++i) {
+        threads[i].join();
+      }
+      begin = end;
     }
     fprintf(
         stderr,
-        "% 8d counted, % 2d duplicates, size %4d\n",
-        counted, int(counted - rapidash.size()), current_size);
+        "% 8d counted, % 2d fingerprint collisions, size %4d\n",
+        counted, int(counted - fingerprints.size()), current_size);
     fflush(stderr);
   }
   fprintf(stderr, "\n\nTotal states seen = %d\n", counted);
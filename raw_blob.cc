@@ -0,0 +1,125 @@
+// Provides the tables declared in raw_data.h by memory-mapping the file
+// written by `generate_tables --blob`.  The file is named by $WORDLE_RAW_DATA,
+// defaulting to raw_data.bin in the working directory.
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "mapped_file.h"
+#include "raw_blob.h"
+#include "raw_data.h"
+#include "state.h"
+
+namespace raw {
+
+static_assert(sizeof(BlobBranch) == sizeof(Indices));
+static_assert(sizeof(wordle::PackedWord) == sizeof(uint64_t));
+static_assert(offsetof(BlobBranch, bit_count) == offsetof(Indices, bit_count));
+static_assert(offsetof(BlobBranch, mask_index) ==
+              offsetof(Indices, mask_index));
+
+int num_factors;
+absl::Span<const Mask> factor_masks[kMaxFactors];
+CompactMaskTable compact_factor_masks[kMaxFactors];
+absl::Span<const Guess> guesses;
+
+namespace {
+
+class BlobLoader {
+ public:
+  BlobLoader() {
+    const char* path = getenv("WORDLE_RAW_DATA");
+    if (path == nullptr) {
+      path = "raw_data.bin";
+    }
+    file_ = wordle::MappedFile::Open(path);
+    if (!file_) {
+      fprintf(stderr, "Could not map raw tables from %s\n", path);
+      exit(1);
+    }
+    BlobHeader header;
+    if (file_->size() < sizeof(header)) {
+      Fail(path);
+    }
+    memcpy(&header, file_->data(), sizeof(header));
+    if (memcmp(header.magic, kBlobMagic, sizeof(kBlobMagic)) != 0 ||
+        header.version != kBlobVersion ||
+        header.num_targets != wordle::kNumTargets ||
+        header.num_words != wordle::State::kNumWords ||
+        header.total_size != file_->size() || !BlobSectionsFit(header)) {
+      Fail(path);
+    }
+    const std::vector<wordle::PackedWord>& words =
+        wordle::Word::AllPackedWords();
+    if (header.num_guesses != words.size() ||
+        memcmp(file_->data() + header.words_offset, words.data(),
+               words.size() * sizeof(uint64_t)) != 0) {
+      fprintf(stderr, "%s was generated from a different dictionary\n", path);
+      exit(1);
+    }
+    const uint16_t* target_order = reinterpret_cast<const uint16_t*>(
+        file_->data() + header.target_order_offset);
+    if (!IsTargetOrder(target_order, header.num_targets)) {
+      Fail(path);
+    }
+    wordle::SetTargetOrder(target_order);
+    num_factors = header.num_factors;
+    for (int f = 0; f < num_factors; ++f) {
+      const BlobFactor& factor = header.factors[f];
+      factor_masks[f] = absl::MakeConstSpan(
+          reinterpret_cast<const Mask*>(file_->data() + factor.masks_offset),
+          factor.num_masks);
+      compact_factor_masks[f] = {
+          Words(factor.compact_headers_offset, factor.num_masks),
+          Words(factor.compact_words_offset, factor.num_compact_words)};
+    }
+
+    const Indices* branches = reinterpret_cast<const Indices*>(
+        file_->data() + header.branches_offset);
+    const BlobGuess* blob_guesses = reinterpret_cast<const BlobGuess*>(
+        file_->data() + header.guesses_offset);
+    for (uint32_t i = 0; i < header.num_guesses; ++i) {
+      const BlobGuess& g = blob_guesses[i];
+      if (uint64_t{g.first_branch} + g.num_branches > header.num_branches) {
+        Fail(path);
+      }
+      guesses_.emplace_back(g.word, branches + g.first_branch,
+                            g.num_branches);
+      for (const Indices& br : guesses_.back().branches) {
+        for (int f = 0; f < num_factors; ++f) {
+          if (br.mask_index[f] >= header.factors[f].num_masks) {
+            Fail(path);
+          }
+        }
+      }
+    }
+    guesses = guesses_;
+    MaybeUseHugePages();
+  }
+
+ private:
+  absl::Span<const uint64_t> Words(uint64_t offset, uint32_t count) const {
+    return absl::MakeConstSpan(
+        reinterpret_cast<const uint64_t*>(file_->data() + offset), count);
+  }
+
+  [[noreturn]] static void Fail(const char* path) {
+    fprintf(stderr, "%s is not a valid version %u raw table file\n", path,
+            kBlobVersion);
+    exit(1);
+  }
+
+  std::unique_ptr<wordle::MappedFile> file_;
+  std::vector<Guess> guesses_;
+};
+
+__attribute__((init_priority(kTablesInitPriority)))
+const BlobLoader loader;
+
+}  // namespace
+
+}  // namespace raw
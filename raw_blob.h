@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// On-disk layout of the binary form of the raw tables, as written by
+// `generate_tables --blob=<path>` and mapped by the raw_data_mmap library.
+//
+// Every branch mask is the AND of one mask from each of num_factors factor
+// tables.  Factor f holds the masks produced by guessing only the letters in
+// BlobFactor::letters (bit `c - 'a'` per letter), so the letters of all
+// factors partition the alphabet.
+//
+// The file starts with a BlobHeader.  Each table follows at the offset
+// recorded in the header, aligned to kBlobAlignment bytes:
+//   words:                     num_guesses uint64_t
+//   target order:              num_targets uint16_t
+//   branches:                  num_branches BlobBranch records
+//   guesses:                   num_guesses BlobGuess records
+// and for each factor:
+//   masks:                     num_masks * num_words uint64_t
+//   compact headers:           num_masks uint64_t
+//   compact words:             num_compact_words uint64_t
+// All integers are little-endian.
+//
+// The words table records the dictionary the tables were built from: every
+// word in index order as a wordle::PackedWord, targets first.  Word indices
+// elsewhere in the file refer to it.  Bit i of every mask stands for the
+// target whose index is entry i of the target order (see
+// wordle::SetTargetOrder).
+//
+// The compact tables hold the same masks as the plain ones with their zero
+// words dropped.  Each mask has a header whose low kCompactOffsetShift bits
+// flag the nonzero words, and whose high bits give the offset of the first of
+// those words in the word array.
+
+namespace raw {
+
+constexpr char kBlobMagic[8] = {'W', 'R', 'D', 'L', 'R', 'A', 'W', '\0'};
+
+// Bumped whenever the layout changes.
+constexpr uint32_t kBlobVersion = 5;
+
+constexpr uint64_t kBlobAlignment = 64;
+
+constexpr int kCompactOffsetShift = 37;
+constexpr uint64_t kCompactPresentMask =
+    (uint64_t{1} << kCompactOffsetShift) - 1;
+
+// The most factor tables a branch can be split across.
+constexpr int kMaxFactors = 4;
+
+// The most masks one factor table can hold, since branches index them with
+// 16 bits.
+constexpr uint32_t kMaxFactorMasks = uint32_t{UINT16_MAX} + 1;
+
+struct BlobFactor {
+  uint32_t letters;
+  uint32_t num_masks;
+  uint32_t num_compact_words;
+  uint32_t reserved;
+  uint64_t masks_offset;
+  uint64_t compact_headers_offset;
+  uint64_t compact_words_offset;
+};
+
+struct BlobHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_targets;
+  uint32_t num_words;
+  uint32_t num_factors;
+  uint32_t num_branches;
+  uint32_t num_guesses;
+  uint64_t words_offset;
+  uint64_t target_order_offset;
+  uint64_t branches_offset;
+  uint64_t guesses_offset;
+  uint64_t total_size;
+  BlobFactor factors[kMaxFactors];
+};
+
+// Layout-compatible with raw::Indices.  Entries of mask_index past
+// num_factors are zero.
+struct BlobBranch {
+  uint16_t colors;
+  uint16_t bit_count;
+  uint16_t mask_index[kMaxFactors];
+};
+
+struct BlobGuess {
+  uint16_t word;
+  uint16_t num_branches;
+  uint32_t first_branch;
+};
+
+inline bool BlobSectionFits(const BlobHeader& header, uint64_t offset,
+                            uint64_t size) {
+  return offset % kBlobAlignment == 0 && offset <= header.total_size &&
+         size <= header.total_size - offset;
+}
+
+// Returns true if every table described by `header` lies within
+// header.total_size bytes.  Does not check the magic or version.
+inline bool BlobSectionsFit(const BlobHeader& header) {
+  if (header.num_factors < 1 || header.num_factors > kMaxFactors ||
+      !BlobSectionFits(header, header.words_offset,
+                       header.num_guesses * uint64_t{8}) ||
+      !BlobSectionFits(header, header.target_order_offset,
+                       header.num_targets * uint64_t{2}) ||
+      !BlobSectionFits(header, header.branches_offset,
+                       header.num_branches * sizeof(BlobBranch)) ||
+      !BlobSectionFits(header, header.guesses_offset,
+                       header.num_guesses * sizeof(BlobGuess))) {
+    return false;
+  }
+  for (uint32_t f = 0; f < header.num_factors; ++f) {
+    const BlobFactor& factor = header.factors[f];
+    if (factor.num_masks > kMaxFactorMasks ||
+        !BlobSectionFits(header, factor.masks_offset,
+                         factor.num_masks * uint64_t{8} * header.num_words) ||
+        !BlobSectionFits(header, factor.compact_headers_offset,
+                         factor.num_masks * uint64_t{8}) ||
+        !BlobSectionFits(header, factor.compact_words_offset,
+                         factor.num_compact_words * uint64_t{8})) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns true if `order` holds each of [0, num_targets) once.
+inline bool IsTargetOrder(const uint16_t* order, uint32_t num_targets) {
+  std::vector<bool> seen(num_targets);
+  for (uint32_t i = 0; i < num_targets; ++i) {
+    if (order[i] >= num_targets || seen[order[i]]) return false;
+    seen[order[i]] = true;
+  }
+  return true;
+}
+
+}  // namespace raw
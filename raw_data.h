@@ -5,23 +5,75 @@
 
 #include "color_guess.h"
 #include "dictionary.h"
+#include "raw_blob.h"
+#include "state.h"
 #include "absl/types/span.h"
 
 namespace raw {
 
-extern const std::array<uint64_t, 37> vowel_masks[13912];
-extern const std::array<uint64_t, 37> consonant_masks[36215];
+using Mask = std::array<uint64_t, 37>;
+
+// The tables are provided either by the generated raw_data.cc, or by
+// raw_blob.cc mapping the output of `generate_tables --blob`.  Either way the
+// provider sets them up, and installs the target order their masks use (see
+// wordle::SetTargetOrder), from a static initializer with
+// kTablesInitPriority.  That runs before every static initializer of default
+// priority in any file, so those may use the tables, and any Word or State
+// they build sees the installed order.
+//
+// Each branch mask is the AND of one entry from each of the first
+// `num_factors` factor tables; see raw_blob.h.  The default grouping has two
+// factors, the letters "aeiouys" and the rest.
+//
+// Partitioning reads only the compact tables below.  The plain ones stay in
+// the mapped file or the binary's read-only data for bench and other tools,
+// so their pages are not resident unless a tool reads them.
+extern int num_factors;
+extern absl::Span<const Mask> factor_masks[kMaxFactors];
+
+// For __attribute__((init_priority)); 101 is the earliest allowed.
+constexpr int kTablesInitPriority = 101;
+
+// The same masks with their zero words dropped; see raw_blob.h for the
+// encoding.  These are a third the size of the plain tables.
+struct CompactMaskTable {
+  absl::Span<const uint64_t> headers;
+  absl::Span<const uint64_t> words;
+
+  wordle::CompactMask operator[](int index) const {
+    const uint64_t header = headers[index];
+    return {header & kCompactPresentMask,
+            words.data() + (header >> kCompactOffsetShift)};
+  }
+};
+
+extern CompactMaskTable compact_factor_masks[kMaxFactors];
 
 struct Indices {
   wordle::Colors colors;
-  uint16_t vowel_index;
-  uint16_t consonant_index;
+  // The number of targets in this branch when guessing from the initial
+  // state.
+  uint16_t bit_count;
+  // Index into each factor table.  Entries past num_factors are unused.
+  uint16_t mask_index[kMaxFactors];
 
-  const std::array<uint64_t, 37>& Mask1() const {
-    return vowel_masks[vowel_index];
+  const Mask& FactorMask(int factor) const {
+    return factor_masks[factor][mask_index[factor]];
+  }
+  wordle::CompactMask CompactFactorMask(int factor) const {
+    return compact_factor_masks[factor][mask_index[factor]];
   }
-  const std::array<uint64_t, 37>& Mask2() const {
-    return consonant_masks[consonant_index];
+
+  // Fills `out` with the num_factors masks of this branch.
+  void FactorMasks(const Mask** out) const {
+    for (int f = 0; f < num_factors; ++f) {
+      out[f] = &FactorMask(f);
+    }
+  }
+  void CompactFactorMasks(wordle::CompactMask* out) const {
+    for (int f = 0; f < num_factors; ++f) {
+      out[f] = CompactFactorMask(f);
+    }
   }
 };
 
@@ -29,9 +81,16 @@ struct Guess {
   constexpr Guess(int w, const Indices* ptr, int len)
       : word(w), branches(ptr, len) {}
   wordle::Word word;
+  // Sorted by bit_count, largest first.
   absl::Span<const Indices> branches;
 };
 
-extern const Guess guesses[12947];
+extern absl::Span<const Guess> guesses;
+
+// Called by the table providers once the tables are set up.  If
+// $WORDLE_HUGE_PAGES is set, copies the compact masks and the branches into
+// huge pages (see wordle::HugePageBuffer), points the tables at the copies,
+// and logs to stderr how much of them the kernel backed with huge pages.
+void MaybeUseHugePages();
 
-}  // namespace raw
\ No newline at end of file
+}  // namespace raw
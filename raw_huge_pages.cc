@@ -0,0 +1,81 @@
+// Moves the raw tables into huge pages when $WORDLE_HUGE_PAGES is set.  Part
+// of both raw_data and raw_data_mmap.
+
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "huge_pages.h"
+#include "raw_blob.h"
+#include "raw_data.h"
+
+namespace raw {
+
+namespace {
+
+size_t Aligned(size_t size) {
+  return (size + kBlobAlignment - 1) / kBlobAlignment * kBlobAlignment;
+}
+
+template <typename T>
+size_t TableBytes(absl::Span<const T> table) {
+  return Aligned(table.size() * sizeof(T));
+}
+
+// Copies `table` to `*next` and advances it past the copy.
+template <typename T>
+absl::Span<const T> CopyTable(absl::Span<const T> table, char** next) {
+  T* copy = reinterpret_cast<T*>(*next);
+  if (!table.empty()) {
+    memcpy(copy, table.data(), table.size() * sizeof(T));
+  }
+  *next += TableBytes(table);
+  return absl::MakeConstSpan(copy, table.size());
+}
+
+}  // namespace
+
+void MaybeUseHugePages() {
+  if (!wordle::HugePagesEnabled()) return;
+  size_t size = 0;
+  size_t num_branches = 0;
+  for (int f = 0; f < num_factors; ++f) {
+    size += TableBytes(compact_factor_masks[f].headers) +
+            TableBytes(compact_factor_masks[f].words);
+  }
+  for (const Guess& guess : guesses) {
+    num_branches += guess.branches.size();
+  }
+  size += Aligned(num_branches * sizeof(Indices));
+
+  std::unique_ptr<wordle::HugePageBuffer> buffer =
+      wordle::HugePageBuffer::Allocate(size);
+  if (!buffer) {
+    fprintf(stderr, "Raw tables: could not map %.1f MB for huge pages\n",
+            size / 1e6);
+    return;
+  }
+  char* next = buffer->data();
+  for (int f = 0; f < num_factors; ++f) {
+    compact_factor_masks[f] = {
+        CopyTable(compact_factor_masks[f].headers, &next),
+        CopyTable(compact_factor_masks[f].words, &next)};
+  }
+  // The copies live for the rest of the program, like the tables they replace.
+  std::vector<Guess>* huge_guesses = new std::vector<Guess>;
+  Indices* branches = reinterpret_cast<Indices*>(next);
+  for (const Guess& guess : guesses) {
+    memcpy(branches, guess.branches.data(),
+           guess.branches.size() * sizeof(Indices));
+    huge_guesses->emplace_back(guess.word.ToIndex(), branches,
+                               guess.branches.size());
+    branches += guess.branches.size();
+  }
+  guesses = *huge_guesses;
+  fprintf(stderr, "Raw tables: %.1f of %.1f MB in huge pages (%s)\n",
+          buffer->huge_bytes() / 1e6, buffer->size() / 1e6, buffer->source());
+  buffer.release();
+}
+
+}  // namespace raw
@@ -4,10 +4,18 @@
 
 #include <array>
 #include <cstdint>
-#include <map>
+#include <limits>
+#include <numeric>
 #include <tuple>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/numeric/bits.h"
+#include "absl/types/span.h"
+#include "huge_pages.h"
+#include "partition_dedup.h"
+#include "partition_dominance.h"
+#include "partition_map.h"
 #include "raw_data.h"
 #include "state.h"
 
@@ -35,6 +43,9 @@ class BitReducer {
     return Word();
   }
 
+  // The target at each bit of a reduced state.
+  absl::Span<const Word> words() const { return words_; }
+
  private:
   struct ReduceStep {
     uint64_t select_mask;
@@ -48,38 +59,32 @@ class BitReducer {
 
 struct PackedReducedBranch {
   Colors colors;
-  uint16_t vowel_index;
-  uint16_t consonant_index;
+  // Index into each reduced factor table; unused entries are zero.
+  std::array<uint16_t, raw::kMaxFactors> mask_index;
   uint16_t num_bits;
 
   struct LongFirst {
     bool operator()(const PackedReducedBranch& lhs,
                     const PackedReducedBranch& rhs) const {
-      return std::tie(lhs.num_bits, lhs.vowel_index, lhs.consonant_index) >
-             std::tie(rhs.num_bits, rhs.vowel_index, rhs.consonant_index);
+      return std::tie(lhs.num_bits, lhs.mask_index) >
+             std::tie(rhs.num_bits, rhs.mask_index);
     }
   };
   struct ShortFirst {
     bool operator()(const PackedReducedBranch& lhs,
                     const PackedReducedBranch& rhs) const {
-      return std::tie(lhs.num_bits, lhs.vowel_index, lhs.consonant_index) <
-             std::tie(rhs.num_bits, rhs.vowel_index, rhs.consonant_index);
+      return std::tie(lhs.num_bits, lhs.mask_index) <
+             std::tie(rhs.num_bits, rhs.mask_index);
     }
   };
   struct MaskEq {
     bool operator()(const PackedReducedBranch& lhs,
                     const PackedReducedBranch& rhs) const {
-      return lhs.vowel_index == rhs.vowel_index &&
-             lhs.consonant_index == rhs.consonant_index;
+      return lhs.mask_index == rhs.mask_index;
     }
   };
 };
 
-struct PackedReducedGuess {
-  Word word;
-  std::vector<PackedReducedBranch> branches;
-};
-
 template <int num_words>
 struct ReducedBranch {
   Colors colors;
@@ -93,25 +98,165 @@ struct ReducedGuess {
   std::vector<ReducedBranch<num_words>> branches;
 };
 
+template <int num_words>
+class ReducedPartitions;
+
+// The products of a reduced state with each mask of the first factor table,
+// with the number of bits in each, as FactorProducts keeps for full states.
+// A reduced table has few first factor masks (about 250 for the branch
+// raise/00000, whose guesses have 144000 branches), so every product is
+// computed up front.  Reused from one state to the next.
+template <int num_words>
+struct ReducedFactorProducts {
+  std::vector<std::array<uint64_t, num_words>> masks;
+  std::vector<int> num_bits;
+};
+
+// The result of ReducedPartitions::SubPartitions in flat form, like
+// PartitionList: one branch array shared by every guess.  Refilling a list
+// reuses its buffers.
+template <int num_words>
+class ReducedPartitionList {
+ public:
+  struct Entry {
+    Word word;
+    absl::Span<const ReducedBranch<num_words>> branches;
+  };
+
+  int size() const { return order_.size(); }
+  bool empty() const { return order_.empty(); }
+
+  Entry operator[](int i) const {
+    const int g = order_[i];
+    return {words_[g], Branches(g)};
+  }
+
+ private:
+  friend class ReducedPartitions<num_words>;
+
+  absl::Span<const ReducedBranch<num_words>> Branches(int g) const {
+    return absl::MakeConstSpan(branches_.data() + begin_[g],
+                               begin_[g + 1] - begin_[g]);
+  }
+
+  // Per guess with any branches; begin_ has one more entry, the end of the
+  // last guess.
+  std::vector<Word> words_;
+  std::vector<uint32_t> begin_;
+  std::vector<ReducedBranch<num_words>> branches_;
+  // Per guess, for finding duplicates; see PartitionDedup.
+  std::vector<uint64_t> fingerprints_;
+  // The guesses in result order, after removing duplicates and sorting.
+  std::vector<int> order_;
+
+  // Scratch space for building branches and sorting the distinct guesses.
+  ReducedFactorProducts<num_words> products_;
+  PartitionDedup dedup_;
+  std::vector<std::pair<uint64_t, int>> keys_;
+};
+
+// The partitions of a state from ReducedPartitions::StreamPartitions, one at
+// a time, best first: in increasing order of `bound`, the sum of
+// 2 * num_bits - 1 over their branches, which is the lower bound the scorers
+// start from (less the state's own count).  Only the partitions asked for are
+// built, so a scorer that stops once the bound reaches its limit pays
+// nothing more for the guesses it never examines.  As with SubPartitions, a
+// guess with the same partition as one already produced is skipped.
+// Refilling a stream reuses its buffers.
+template <int num_words>
+class ReducedPartitionStream {
+ public:
+  struct Entry {
+    Word word;
+    int bound;
+    absl::Span<const ReducedBranch<num_words>> branches;
+  };
+
+  // Sets `*entry` to the next partition, with its branches sorted largest
+  // first, and returns true; or returns false if there are none left.  The
+  // branches are valid until the next call.
+  bool Next(Entry* entry);
+
+  // The bound of the next partition Next() may produce, or INT_MAX if there
+  // are none left.  Skipped duplicates can only make the next one's higher.
+  int NextBound() const {
+    return next_ < int(candidates_.size()) ? candidates_[next_].first
+                                           : std::numeric_limits<int>::max();
+  }
+
+  // The number of guesses with any branches, and the number built so far.
+  int num_candidates() const { return candidates_.size(); }
+  int num_built() const { return next_; }
+
+  // The number of guesses the stream was started with, and the number of
+  // them live_guesses() found dominated.
+  int num_scanned() const { return num_scanned_; }
+  int num_dominated() const {
+    return dominance_checked_ ? dominance_.num_dominated() : 0;
+  }
+
+  // The guesses with any branches, less those found so far to duplicate
+  // another, in increasing order: the live guesses of every branch of the
+  // input; see ReducedPartitions::StreamPartitions.  Valid until the next
+  // call to Next().  As with PartitionStream::live_guesses(), the first call
+  // also drops the guesses dominated by one with a lower bound.
+  absl::Span<const int> live_guesses();
+
+ private:
+  friend class ReducedPartitions<num_words>;
+
+  absl::Span<const ReducedBranch<num_words>> Branches(int p) const {
+    return absl::MakeConstSpan(branches_.data() + begin_[p],
+                               begin_[p + 1] - begin_[p]);
+  }
+
+  const ReducedPartitions<num_words>* partitions_ = nullptr;
+  std::array<uint64_t, num_words> input_;
+  ReducedFactorProducts<num_words> products_;
+  // The bound and index of each guess with any branches, in the order they
+  // are produced.
+  std::vector<std::pair<int, int>> candidates_;
+  int next_ = 0;
+  int num_scanned_ = 0;
+  LiveGuesses live_;
+  // The partitions produced so far, kept for finding duplicates; partition
+  // p's branches are branches_[begin_[p], begin_[p + 1]).
+  std::vector<ReducedBranch<num_words>> branches_;
+  std::vector<uint32_t> begin_;
+  PartitionDedup dedup_;
+  DominanceFilter dominance_;
+  bool dominance_checked_ = false;
+  // The indices of the input's targets, for dominance_.
+  std::vector<uint16_t> targets_;
+};
+
 template <int num_words>
 class ReducedMaskTable {
  public:
-  template <typename Source>
-  ReducedMaskTable(const Source& s, const BitReducer& reducer) {
-    std::deque<std::array<uint64_t, num_words>> reduced_masks_deque;
-    int count = std::end(s) - std::begin(s);
-    std::map<std::array<uint64_t, num_words>, int> lookup;
+  // Reads the compact form of the factor table, decoding each mask into
+  // scratch, so the plain tables are never paged in.
+  ReducedMaskTable(const raw::CompactMaskTable& table,
+                   const BitReducer& reducer) {
+    const int count = table.headers.size();
+    absl::flat_hash_map<std::array<uint64_t, num_words>, int> lookup;
+    full_to_reduced_index_map_.reserve(count);
+    raw::Mask mask;
     for (int idx = 0; idx < count; ++idx) {
+      const CompactMask compact = table[idx];
+      mask.fill(0);
+      const uint64_t* word = compact.words;
+      for (uint64_t present = compact.present; present != 0;
+           present &= present - 1) {
+        mask[absl::countr_zero(present)] = *word++;
+      }
       std::array<uint64_t, num_words> reduced =
-          reducer.Reduce<num_words>(s[idx]);
+          reducer.Reduce<num_words>(mask);
       auto res = lookup.try_emplace(reduced, lookup.size());
       if (res.second) {  // insertion successful
-        reduced_masks_deque.push_back(reduced);
+        reduced_masks_.push_back(reduced);
       }
       full_to_reduced_index_map_.push_back(res.first->second);
     }
-    reduced_masks_ = std::vector<std::array<uint64_t, num_words>>(
-        reduced_masks_deque.begin(), reduced_masks_deque.end());
   }
 
   int size() const { return reduced_masks_.size(); }
@@ -126,7 +271,10 @@ class ReducedMaskTable {
   }
 
  private:
-  std::vector<std::array<uint64_t, num_words>> reduced_masks_;
+  // Large tables go in huge pages when enabled; see HugePagesEnabled().
+  std::vector<std::array<uint64_t, num_words>,
+              HugePageAllocator<std::array<uint64_t, num_words>>>
+      reduced_masks_;
   std::vector<int> full_to_reduced_index_map_; 
 };
 
@@ -134,9 +282,15 @@ template <int num_words>
 class ReducedPartitions {
  public:
   ReducedPartitions(const State& mask)
-      : reducer_(mask),
-        vowel_masks_(raw::vowel_masks, reducer_),
-        consonant_masks_(raw::consonant_masks, reducer_) {
+      : ReducedPartitions(mask, AllGuesses()) {}
+
+  // Only the guesses with these raw::guesses indices, in increasing order,
+  // such as the live guesses of a parent of `mask`; see SubPartitions.
+  ReducedPartitions(const State& mask, absl::Span<const int> guesses)
+      : reducer_(mask) {
+    for (int f = 0; f < raw::num_factors; ++f) {
+      factor_masks_.emplace_back(raw::compact_factor_masks[f], reducer_);
+    }
     if (mask.count() > 64 * num_words) {
       __builtin_trap();
     }
@@ -153,49 +307,82 @@ class ReducedPartitions {
       }
     }
 /*
-    std::cerr << "Vowel masks reduced from " << 13912 << " to "
-              << vowel_masks_.size() << "\n";
-    std::cerr << "Consonant masks reduced from " << 36237 << " to "
-              << consonant_masks_.size() << "\n";
+    for (int f = 0; f < raw::num_factors; ++f) {
+      std::cerr << "Factor " << f << " masks reduced from "
+                << raw::compact_factor_masks[f].headers.size() << " to "
+                << factor_masks_[f].size() << "\n";
+    }
 */
     int total_branch_count_debug = 0;
     int reduced_branch_count_debug = 0;
-    for (const raw::Guess& raw_guess : raw::guesses) {
-      PackedReducedGuess reduced_guess;
-      reduced_guess.word = raw_guess.word;
+    // Every guess's branches in one array, then only the distinct guesses in
+    // order, so building the table takes a handful of allocations rather than
+    // one per guess.
+    std::vector<Word> words;
+    std::vector<uint32_t> begin;
+    std::vector<PackedReducedBranch> branches;
+    for (int raw_g : guesses) {
+      const raw::Guess& raw_guess = raw::guesses[raw_g];
+      const size_t guess_begin = branches.size();
       for (const raw::Indices& branch : raw_guess.branches) {
         PackedReducedBranch br = Reduce(branch);
         ++total_branch_count_debug;
         if (br.num_bits != 0 && br.num_bits < mask.count()) {
-          reduced_guess.branches.push_back(br);
+          branches.push_back(br);
           ++reduced_branch_count_debug;
         }
       }
-      if (!reduced_guess.branches.empty()) {
-        std::sort(reduced_guess.branches.begin(), reduced_guess.branches.end(),
+      if (branches.size() != guess_begin) {
+        std::sort(branches.begin() + guess_begin, branches.end(),
                   PackedReducedBranch::ShortFirst{});
-        guesses_.push_back(reduced_guess);
+        words.push_back(raw_guess.word);
+        begin.push_back(guess_begin);
       }
     }
-    auto guess_lt = [](const PackedReducedGuess& lhs,
-                       const PackedReducedGuess& rhs) {
-      return std::lexicographical_compare(
-          lhs.branches.begin(), lhs.branches.end(), rhs.branches.begin(),
-          rhs.branches.end(), PackedReducedBranch::LongFirst{});
+    begin.push_back(branches.size());
+    auto guess_branches = [&](int g) {
+      return absl::MakeConstSpan(branches.data() + begin[g],
+                                 begin[g + 1] - begin[g]);
     };
-    std::sort(guesses_.begin(), guesses_.end(), guess_lt);
 
-    auto guess_eq = [](const PackedReducedGuess& lhs,
-                       const PackedReducedGuess& rhs) {
-      return lhs.branches.size() == rhs.branches.size() &&
-             std::equal(lhs.branches.begin(), lhs.branches.end(),
-                        rhs.branches.begin(), PackedReducedBranch::MaskEq{});
+    std::vector<int> order(words.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto guess_lt = [&](int lhs, int rhs) {
+      absl::Span<const PackedReducedBranch> l = guess_branches(lhs);
+      absl::Span<const PackedReducedBranch> r = guess_branches(rhs);
+      return std::lexicographical_compare(l.begin(), l.end(), r.begin(),
+                                          r.end(),
+                                          PackedReducedBranch::LongFirst{});
+    };
+    std::sort(order.begin(), order.end(), guess_lt);
+
+    auto guess_eq = [&](int lhs, int rhs) {
+      absl::Span<const PackedReducedBranch> l = guess_branches(lhs);
+      absl::Span<const PackedReducedBranch> r = guess_branches(rhs);
+      return l.size() == r.size() &&
+             std::equal(l.begin(), l.end(), r.begin(),
+                        PackedReducedBranch::MaskEq{});
     };
-    guesses_.erase(std::unique(guesses_.begin(), guesses_.end(), guess_eq),
-                   guesses_.end());
+    order.erase(std::unique(order.begin(), order.end(), guess_eq),
+                order.end());
+
+    guess_words_.reserve(order.size());
+    guess_begin_.reserve(order.size() + 1);
+    for (int g : order) {
+      guess_words_.push_back(words[g]);
+      guess_begin_.push_back(guess_branches_.size());
+      absl::Span<const PackedReducedBranch> b = guess_branches(g);
+      guess_branches_.insert(guess_branches_.end(), b.begin(), b.end());
+    }
+    guess_begin_.push_back(guess_branches_.size());
+    all_guesses_.resize(guess_words_.size());
+    std::iota(all_guesses_.begin(), all_guesses_.end(), 0);
+    for (Word target : reducer_.words()) {
+      bit_targets_.push_back(target.ToIndex());
+    }
 /*
     std::cerr << "Guesses reduced from " << kNumTargets + kNumNonTargets
-              << " to " << guesses_.size() << "\n";
+              << " to " << guess_words_.size() << "\n";
     std::cerr << "Total branches reduced from " << total_branch_count_debug
               << " to " << reduced_branch_count_debug << "\n";
 */
@@ -203,6 +390,9 @@ class ReducedPartitions {
 
   const std::array<uint64_t, num_words>& FullMask() const { return full_mask_; }
 
+  // The index of every guess StreamPartitions can be given, in order.
+  absl::Span<const int> all_guesses() const { return all_guesses_; }
+
   Word Exemplar(const std::array<uint64_t, num_words>& state) const {
     return reducer_.Exemplar<num_words>(state);
   }
@@ -210,21 +400,65 @@ class ReducedPartitions {
   std::vector<ReducedGuess<num_words>> SubPartitions(
       const std::array<uint64_t, num_words>& input) const;
 
+  // As above, but into `out`, replacing its contents.
+  void SubPartitions(const std::array<uint64_t, num_words>& input,
+                     ReducedPartitionList<num_words>* out) const;
+
+  // Sets `out` to produce the partitions of `input` best first.  This
+  // counts every guess's branches, but builds and sorts none of them; see
+  // ReducedPartitionStream.  `*this` must outlive the stream's use.
+  void StreamPartitions(const std::array<uint64_t, num_words>& input,
+                        ReducedPartitionStream<num_words>* out) const {
+    StreamPartitions(input, all_guesses_, out);
+  }
+
+  // As above, by only the guesses in `guesses`, such as the live guesses of
+  // a stream of a parent of `input`.  As with SubPartitions on full states,
+  // those give the same partitions as every guess does.
+  void StreamPartitions(const std::array<uint64_t, num_words>& input,
+                        absl::Span<const int> guesses,
+                        ReducedPartitionStream<num_words>* out) const;
+
  private:
+  friend class ReducedPartitionStream<num_words>;
+
+  // Appends to `out` the branches of guess `g` from `input` that are
+  // neither empty nor all of `input`, sorted largest first, and returns the
+  // guess's PartitionDedup fingerprint.  `products` are those of `input`.
+  uint64_t AppendBranches(int g, const std::array<uint64_t, num_words>& input,
+                          const ReducedFactorProducts<num_words>& products,
+                          std::vector<ReducedBranch<num_words>>* out) const;
+
+  // Sets `products` to those of `input`.
+  void MultiplyFirstFactor(const std::array<uint64_t, num_words>& input,
+                           ReducedFactorProducts<num_words>* products) const {
+    const ReducedMaskTable<num_words>& first = factor_masks_[0];
+    products->masks.resize(first.size());
+    products->num_bits.resize(first.size());
+    for (int m = 0; m < first.size(); ++m) {
+      const std::array<uint64_t, num_words>& mask =
+          first.LookupByReducedIndex(m);
+      int num_bits = 0;
+      for (int i = 0; i < num_words; ++i) {
+        products->masks[m][i] = input[i] & mask[i];
+        num_bits += absl::popcount(products->masks[m][i]);
+      }
+      products->num_bits[m] = num_bits;
+    }
+  }
+
   PackedReducedBranch Reduce(const raw::Indices& ri) const {
     PackedReducedBranch reduced;
     reduced.colors = ri.colors;
-    reduced.vowel_index = vowel_masks_.ReduceFullIndex(ri.vowel_index);
-    reduced.consonant_index =
-        consonant_masks_.ReduceFullIndex(ri.consonant_index);
+    reduced.mask_index.fill(0);
+    for (int f = 0; f < raw::num_factors; ++f) {
+      reduced.mask_index[f] =
+          factor_masks_[f].ReduceFullIndex(ri.mask_index[f]);
+    }
     reduced.num_bits = 0;
-
-    const std::array<uint64_t, num_words>& vowel_mask =
-        vowel_masks_.LookupByReducedIndex(reduced.vowel_index);
-    const std::array<uint64_t, num_words>& consonant_mask =
-        consonant_masks_.LookupByReducedIndex(reduced.consonant_index);
+    const std::array<uint64_t, num_words> mask = MaskState(full_mask_, reduced);
     for (int i = 0; i < num_words; ++i) {
-      reduced.num_bits += absl::popcount(vowel_mask[i] & consonant_mask[i]);
+      reduced.num_bits += absl::popcount(mask[i]);
     }
     return reduced;
   }
@@ -233,20 +467,45 @@ class ReducedPartitions {
       const std::array<uint64_t, num_words>& state,
       const PackedReducedBranch& branch) const {
     std::array<uint64_t, num_words> result = state;
-    const std::array<uint64_t, num_words> vowel_mask =
-        vowel_masks_.LookupByReducedIndex(branch.vowel_index);
-    const std::array<uint64_t, num_words> consonant_mask =
-        consonant_masks_.LookupByReducedIndex(branch.consonant_index);
-    for (int i = 0; i < num_words; ++i) {
-      result[i] &= vowel_mask[i] & consonant_mask[i];
+    for (int f = 0; f < raw::num_factors; ++f) {
+      const std::array<uint64_t, num_words>& factor_mask =
+          factor_masks_[f].LookupByReducedIndex(branch.mask_index[f]);
+      for (int i = 0; i < num_words; ++i) {
+        result[i] &= factor_mask[i];
+      }
+    }
+    return result;
+  }
+
+  // As MaskState, for the state with these products: the branch's first
+  // factor product ANDed with its other factor masks.  Callers skip the
+  // branches whose product is empty, which read no factor masks at all.
+  std::array<uint64_t, num_words> MaskProduct(
+      const ReducedFactorProducts<num_words>& products,
+      const PackedReducedBranch& branch) const {
+    std::array<uint64_t, num_words> result =
+        products.masks[branch.mask_index[0]];
+    for (int f = 1; f < raw::num_factors; ++f) {
+      const std::array<uint64_t, num_words>& factor_mask =
+          factor_masks_[f].LookupByReducedIndex(branch.mask_index[f]);
+      for (int i = 0; i < num_words; ++i) {
+        result[i] &= factor_mask[i];
+      }
     }
     return result;
   }
 
   BitReducer reducer_;
-  ReducedMaskTable<num_words> vowel_masks_;
-  ReducedMaskTable<num_words> consonant_masks_;
-  std::vector<PackedReducedGuess> guesses_;
+  std::vector<ReducedMaskTable<num_words>> factor_masks_;
+  // The distinct guesses, with guess i's branches in
+  // guess_branches_[guess_begin_[i], guess_begin_[i + 1]).
+  std::vector<Word> guess_words_;
+  std::vector<uint32_t> guess_begin_;
+  std::vector<PackedReducedBranch> guess_branches_;
+  // 0, 1, ..., guess_words_.size() - 1.
+  std::vector<int> all_guesses_;
+  // The index of the target at each bit of a reduced state.
+  std::vector<uint16_t> bit_targets_;
   std::array<uint64_t, num_words> full_mask_ = {{0}};
 };
 
@@ -267,7 +526,7 @@ inline BitReducer::BitReducer(const std::array<uint64_t, 37>& mask) {
     while (this_word && cur_shift < 64) {
       int bit_index = absl::countr_zero(this_word);
       uint64_t bit = uint64_t{1} << bit_index;
-      words_.push_back(Word(64 * word_i + bit_index));
+      words_.push_back(TargetAtBit(64 * word_i + bit_index));
       this_word ^= bit;
       step.select_mask |= bit;
       cur_shift += 1;
@@ -300,62 +559,220 @@ template <int num_words>
 std::vector<ReducedGuess<num_words>>
 ReducedPartitions<num_words>::SubPartitions(
     const std::array<uint64_t, num_words>& input) const {
-  std::vector<ReducedGuess<num_words>> result;
-  for (const PackedReducedGuess& packed_guess : guesses_) {
-    result.emplace_back();
-    ReducedGuess<num_words>& guess = result.back();
-    for (const PackedReducedBranch& packed_branch : packed_guess.branches) {
-      guess.branches.emplace_back();
-      ReducedBranch<num_words>& branch = guess.branches.back();
-      branch.mask = MaskState(input, packed_branch);
-      branch.num_bits = 0;
-      for (uint64_t word : branch.mask) {
-        branch.num_bits += absl::popcount(word);
+  ReducedPartitionList<num_words> list;
+  SubPartitions(input, &list);
+  std::vector<ReducedGuess<num_words>> result(list.size());
+  for (int i = 0; i < list.size(); ++i) {
+    const typename ReducedPartitionList<num_words>::Entry entry = list[i];
+    result[i].word = entry.word;
+    result[i].branches.assign(entry.branches.begin(), entry.branches.end());
+  }
+  return result;
+}
+
+template <int num_words>
+void ReducedPartitions<num_words>::SubPartitions(
+    const std::array<uint64_t, num_words>& input,
+    ReducedPartitionList<num_words>* out) const {
+  out->words_.clear();
+  out->begin_.clear();
+  out->branches_.clear();
+  out->fingerprints_.clear();
+  MultiplyFirstFactor(input, &out->products_);
+  for (int g = 0; g < int(guess_words_.size()); ++g) {
+    const size_t begin = out->branches_.size();
+    const uint64_t fingerprint =
+        AppendBranches(g, input, out->products_, &out->branches_);
+    if (out->branches_.size() == begin) continue;
+    out->words_.push_back(guess_words_[g]);
+    out->begin_.push_back(begin);
+    out->fingerprints_.push_back(fingerprint);
+  }
+  out->begin_.push_back(out->branches_.size());
+
+  // Of each set of guesses with the same branch masks, keep the first, found
+  // by hashing.  Then sort the rest lexicographically by their branches,
+  // keyed by the size and first word of the largest: (num_bits, mask)
+  // compares in that order, so only ties read further.
+  auto branch_lt = [](const ReducedBranch<num_words>& lhs,
+                      const ReducedBranch<num_words>& rhs) {
+    return std::tie(lhs.num_bits, lhs.mask) < std::tie(rhs.num_bits, rhs.mask);
+  };
+  auto branch_eq = [](const ReducedBranch<num_words>& lhs,
+                      const ReducedBranch<num_words>& rhs) {
+    return lhs.mask == rhs.mask;
+  };
+  const int num_guesses = out->words_.size();
+  out->dedup_.Reset(num_guesses);
+  out->keys_.clear();
+  for (int g = 0; g < num_guesses; ++g) {
+    const bool seen =
+        out->dedup_.Seen(out->fingerprints_[g], g, [&](int lhs, int rhs) {
+          absl::Span<const ReducedBranch<num_words>> l = out->Branches(lhs);
+          absl::Span<const ReducedBranch<num_words>> r = out->Branches(rhs);
+          return std::equal(l.begin(), l.end(), r.begin(), r.end(),
+                            branch_eq);
+        });
+    if (seen) continue;
+    const ReducedBranch<num_words>& largest = out->Branches(g)[0];
+    out->keys_.emplace_back(
+        (uint64_t{largest.num_bits} << 48) | (largest.mask[0] >> 16), g);
+  }
+  std::sort(out->keys_.begin(), out->keys_.end(),
+            [&](const auto& lhs, const auto& rhs) {
+              if (lhs.first != rhs.first) return lhs.first < rhs.first;
+              absl::Span<const ReducedBranch<num_words>> l =
+                  out->Branches(lhs.second);
+              absl::Span<const ReducedBranch<num_words>> r =
+                  out->Branches(rhs.second);
+              return std::lexicographical_compare(l.begin(), l.end(),
+                                                  r.begin(), r.end(),
+                                                  branch_lt);
+            });
+  out->order_.clear();
+  for (const auto& [key, g] : out->keys_) {
+    out->order_.push_back(g);
+  }
+}
+
+template <int num_words>
+uint64_t ReducedPartitions<num_words>::AppendBranches(
+    int g, const std::array<uint64_t, num_words>& input,
+    const ReducedFactorProducts<num_words>& products,
+    std::vector<ReducedBranch<num_words>>* out) const {
+  const size_t begin = out->size();
+  uint64_t fingerprint = 0;
+  for (uint32_t b = guess_begin_[g]; b < guess_begin_[g + 1]; ++b) {
+    const PackedReducedBranch& packed_branch = guess_branches_[b];
+    if (products.num_bits[packed_branch.mask_index[0]] == 0) continue;
+    ReducedBranch<num_words>& branch = out->emplace_back();
+    branch.mask = MaskProduct(products, packed_branch);
+    branch.num_bits = 0;
+    uint64_t hash = 0;
+    for (uint64_t word : branch.mask) {
+      branch.num_bits += absl::popcount(word);
+      hash = (hash + word) * 0x9e3779b97f4a7c15ULL;
+    }
+    if (branch.num_bits == 0 || branch.mask == input) {
+      out->pop_back();
+    } else {
+      branch.colors = packed_branch.colors;
+      fingerprint += PartitionDedup::HashBranch(hash);
+    }
+  }
+  std::sort(out->begin() + begin, out->end(),
+            [](const ReducedBranch<num_words>& lhs,
+               const ReducedBranch<num_words>& rhs) {
+              return std::tie(lhs.num_bits, lhs.mask) >
+                     std::tie(rhs.num_bits, rhs.mask);
+            });
+  return fingerprint;
+}
+
+template <int num_words>
+void ReducedPartitions<num_words>::StreamPartitions(
+    const std::array<uint64_t, num_words>& input,
+    absl::Span<const int> guesses,
+    ReducedPartitionStream<num_words>* out) const {
+  out->partitions_ = this;
+  out->input_ = input;
+  out->candidates_.clear();
+  out->next_ = 0;
+  out->num_scanned_ = guesses.size();
+  out->live_.Clear();
+  out->branches_.clear();
+  out->begin_.assign(1, 0);
+  int input_bits = 0;
+  for (uint64_t word : input) {
+    input_bits += absl::popcount(word);
+  }
+  MultiplyFirstFactor(input, &out->products_);
+  for (int g : guesses) {
+    int bound = 0;
+    bool any = false;
+    for (uint32_t b = guess_begin_[g]; b < guess_begin_[g + 1]; ++b) {
+      const PackedReducedBranch& branch = guess_branches_[b];
+      if (out->products_.num_bits[branch.mask_index[0]] == 0) continue;
+      const std::array<uint64_t, num_words> mask =
+          MaskProduct(out->products_, branch);
+      int num_bits = 0;
+      for (uint64_t word : mask) {
+        num_bits += absl::popcount(word);
+      }
+      if (num_bits != 0 && num_bits != input_bits) {
+        bound += 2 * num_bits - 1;
+        any = true;
+      }
+    }
+    if (any) {
+      out->candidates_.emplace_back(bound, g);
+      out->live_.Add(g);
+    }
+  }
+  std::sort(out->candidates_.begin(), out->candidates_.end());
+  out->dedup_.Reset(out->candidates_.size());
+  out->dominance_checked_ = false;
+}
+
+template <int num_words>
+absl::Span<const int> ReducedPartitionStream<num_words>::live_guesses() {
+  if (!dominance_checked_) {
+    dominance_checked_ = true;
+    targets_.clear();
+    for (int i = 0; i < num_words; ++i) {
+      for (uint64_t word = input_[i]; word != 0; word &= word - 1) {
+        targets_.push_back(
+            partitions_->bit_targets_[64 * i + absl::countr_zero(word)]);
       }
-      if (branch.num_bits == 0 || branch.mask == input) {
-        guess.branches.pop_back();
+    }
+    dominance_.Reset(targets_, candidates_.size());
+    // As in PartitionStream::live_guesses().
+    int kept = next_;
+    for (int i = 0; i < int(candidates_.size()); ++i) {
+      const int g = candidates_[i].second;
+      const Word word = partitions_->guess_words_[g];
+      if (dominance_.Dominated(word)) {
+        live_.Remove(g);
       } else {
-        branch.colors = packed_branch.colors;
+        dominance_.Keep(word);
+        if (i >= next_) {
+          candidates_[kept++] = candidates_[i];
+        }
       }
     }
-    if (guess.branches.empty()) {
-      result.pop_back();
-    } else {
-      guess.word = packed_guess.word;
-      std::sort(guess.branches.begin(), guess.branches.end(),
-                [](const ReducedBranch<num_words>& lhs,
-                   const ReducedBranch<num_words>& rhs) {
-                  return std::tie(lhs.num_bits, lhs.mask) >
-                         std::tie(rhs.num_bits, rhs.mask);
-                });
+    candidates_.resize(kept);
+  }
+  return live_.Get();
+}
+
+template <int num_words>
+bool ReducedPartitionStream<num_words>::Next(Entry* entry) {
+  while (next_ < int(candidates_.size())) {
+    const auto [bound, g] = candidates_[next_++];
+    const size_t begin = branches_.size();
+    const uint64_t fingerprint =
+        partitions_->AppendBranches(g, input_, products_, &branches_);
+    const int p = begin_.size() - 1;
+    begin_.push_back(branches_.size());
+    const bool seen = dedup_.Seen(fingerprint, p, [this](int lhs, int rhs) {
+      absl::Span<const ReducedBranch<num_words>> l = Branches(lhs);
+      absl::Span<const ReducedBranch<num_words>> r = Branches(rhs);
+      return std::equal(l.begin(), l.end(), r.begin(), r.end(),
+                        [](const ReducedBranch<num_words>& lhs,
+                           const ReducedBranch<num_words>& rhs) {
+                          return lhs.mask == rhs.mask;
+                        });
+    });
+    if (seen) {
+      begin_.pop_back();
+      branches_.resize(begin);
+      live_.Remove(g);
+      continue;
     }
+    *entry = {partitions_->guess_words_[g], bound, Branches(p)};
+    return true;
   }
-  std::sort(result.begin(), result.end(),
-            [](const ReducedGuess<num_words>& lhs,
-               const ReducedGuess<num_words>& rhs) {
-              return std::lexicographical_compare(
-                  lhs.branches.begin(), lhs.branches.end(),
-                  rhs.branches.begin(), rhs.branches.end(),
-                  [](const ReducedBranch<num_words>& lhs,
-                     const ReducedBranch<num_words>& rhs) {
-                    return std::tie(lhs.num_bits, lhs.mask) <
-                           std::tie(rhs.num_bits, rhs.mask);
-                  });
-            });
-  result.erase(
-      std::unique(result.begin(), result.end(),
-                  [](const ReducedGuess<num_words>& lhs,
-                     const ReducedGuess<num_words>& rhs) {
-                    return lhs.branches.size() == rhs.branches.size() &&
-                           std::equal(lhs.branches.begin(), lhs.branches.end(),
-                                      rhs.branches.begin(),
-                                      [](const ReducedBranch<num_words>& lhs,
-                                         const ReducedBranch<num_words>& rhs) {
-                                        return lhs.mask == rhs.mask;
-                                      });
-                  }),
-      result.end());
-  return result;
+  return false;
 }
 
 }  // namespace wordle
\ No newline at end of file
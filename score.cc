@@ -1,30 +1,69 @@
 #include "score.h"
 
+#include <algorithm>
+#include <atomic>
+#include <optional>
+
 #include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "depth_scratch.h"
 #include "reduced_map.h"
+#include "state_key.h"
 
 namespace wordle {
 
 namespace {
 
+// A stored result, with the key of the state it belongs to.  A result added
+// by fingerprint alone has no key until a state with that fingerprint is
+// looked up and claims it.
+struct CachedResult {
+  ScoreResult res;
+  StateKey key;
+};
+
 absl::Mutex big_results_mu;
-absl::flat_hash_map<uint64_t, ScoreResult> big_results;
+absl::flat_hash_map<absl::uint128, CachedResult> big_results;
+// Results from AddLegacyHash whose states have not been looked up yet.
+absl::flat_hash_map<uint64_t, ScoreResult> legacy_results;
+CachedCallback migrated_callback = nullptr;
 
-}  // namespace
+// The partitions being scored at each depth of ScoreState's recursion.
+thread_local DepthScratch<PartitionStream> full_scratch;
 
-bool AddHash(uint64_t rapidash, ScoreResult res) {
-  absl::MutexLock lock(&big_results_mu);
-  return big_results.emplace(rapidash, res).second;
-}
+// Returns the live guesses of a state's parent, which the state is
+// partitioned by.  A state only asks once it is to be partitioned, as the
+// parent's stream takes a pass over its guesses to find them.
+using GuessesFn = absl::FunctionRef<absl::Span<const int>()>;
 
-bool IsCached(const State& s) {
-  uint64_t rapidash = s.Rapidash();
-  absl::MutexLock lock(&big_results_mu);
-  return big_results.contains(rapidash);
+// ScanCounts per depth, with the last holding every depth from there down.
+constexpr int kMaxScanDepth = 16;
+std::atomic<int64_t> scanned_states[kMaxScanDepth];
+std::atomic<int64_t> scanned_guesses[kMaxScanDepth];
+std::atomic<int64_t> dominated_guesses[kMaxScanDepth];
+
+// Counts a state at `depth` partitioned by `partitions`, a PartitionStream or
+// ReducedPartitionStream, once the state is done with it.
+template <typename Stream>
+void CountScan(int depth, const Stream& partitions) {
+  depth = std::min(depth, kMaxScanDepth - 1);
+  scanned_states[depth].fetch_add(1, std::memory_order_relaxed);
+  scanned_guesses[depth].fetch_add(partitions.num_scanned(),
+                                   std::memory_order_relaxed);
+  dominated_guesses[depth].fetch_add(partitions.num_dominated(),
+                                     std::memory_order_relaxed);
 }
 
-int ScoreStatePartition(const State& s, const FullPartition& p, int limit) {
+ScoreResult ScoreStateAtDepth(const State& s, int limit, int depth,
+                              GuessesFn guesses);
+
+// `guesses` returns the live guesses of `s`, which its branches are
+// partitioned by.
+template <typename MaskType>
+int ScoreBranches(const State& s, absl::Span<const Branch<MaskType>> branches,
+                  int limit, int depth, GuessesFn guesses) {
   // The base score is one for each bit in `s`, indicating the
   // guess we're about to make.
   int score = s.count();
@@ -35,10 +74,10 @@ int ScoreStatePartition(const State& s, const FullPartition& p, int limit) {
 
   // To enable early pruning, we first add in a lower bound value for each
   // match.  (A state with N bits has as a lower bound 2N-1 as a score.)
-  for (const FullPartition::BranchType& b : p.branches) {
+  for (const Branch<MaskType>& b : branches) {
     score += 2 * b.mask.count() - 1;
   }
-  for (const FullPartition::BranchType& b : p.branches) {
+  for (const Branch<MaskType>& b : branches) {
     if (score >= limit) {
       // We've hit the limit, exit early
       return kOver;
@@ -47,25 +86,131 @@ int ScoreStatePartition(const State& s, const FullPartition& p, int limit) {
     score -= 2 * b.mask.count() - 1;
     // Recursively call BestScore, subtracting out our score so far from the
     // limit that we pass to the child.
-    score += ScoreState(b.mask, limit - score).first;
+    score += ScoreStateAtDepth(b.mask, limit - score, depth + 1,
+                               guesses)
+                 .first;
   }
   return score;
 }
 
+}  // namespace
+
+namespace {
+
+// Returns the stored result for `s`, if any, rekeying a legacy one.
+std::optional<ScoreResult> FindCached(const State& s) {
+  const absl::uint128 fingerprint = s.Fingerprint();
+  ScoreResult res;
+  CachedCallback migrated;
+  {
+    absl::MutexLock lock(&big_results_mu);
+    auto it = big_results.find(fingerprint);
+    if (it != big_results.end()) {
+      CachedResult& cached = it->second;
+      if (cached.key.empty()) {
+        cached.key = StateKey(s);
+      } else if (!cached.key.Matches(s)) {
+        // Another state with the same fingerprint.
+        return std::nullopt;
+      }
+      return cached.res;
+    }
+    if (legacy_results.empty()) {
+      return std::nullopt;
+    }
+    auto legacy = legacy_results.find(s.Rapidash());
+    if (legacy == legacy_results.end()) {
+      return std::nullopt;
+    }
+    res = legacy->second;
+    legacy_results.erase(legacy);
+    big_results.emplace(fingerprint, CachedResult{res, StateKey(s)});
+    migrated = migrated_callback;
+  }
+  if (migrated != nullptr) {
+    migrated(s, res.first, res.second.ToString());
+  }
+  return res;
+}
+
+}  // namespace
+
+bool AddHash(absl::uint128 fingerprint, ScoreResult res) {
+  absl::MutexLock lock(&big_results_mu);
+  return big_results.emplace(fingerprint, CachedResult{res, StateKey()})
+      .second;
+}
+
+bool IsCached(const State& s) { return FindCached(s).has_value(); }
+
+bool AddLegacyHash(uint64_t rapidash, ScoreResult res) {
+  absl::MutexLock lock(&big_results_mu);
+  return legacy_results.emplace(rapidash, res).second;
+}
+
+void SetMigratedCallback(CachedCallback migrated) {
+  absl::MutexLock lock(&big_results_mu);
+  migrated_callback = migrated;
+}
+
+std::vector<ScanCounts> GetScanCounts() {
+  std::vector<ScanCounts> counts;
+  for (int depth = 0; depth < kMaxScanDepth; ++depth) {
+    ScanCounts c;
+    c.states = scanned_states[depth].load(std::memory_order_relaxed);
+    c.guesses = scanned_guesses[depth].load(std::memory_order_relaxed);
+    c.dominated = dominated_guesses[depth].load(std::memory_order_relaxed);
+    if (c.states == 0) break;
+    counts.push_back(c);
+  }
+  return counts;
+}
+
+void ResetScanCounts() {
+  for (int depth = 0; depth < kMaxScanDepth; ++depth) {
+    scanned_states[depth].store(0, std::memory_order_relaxed);
+    scanned_guesses[depth].store(0, std::memory_order_relaxed);
+    dominated_guesses[depth].store(0, std::memory_order_relaxed);
+  }
+}
+
+int ScoreStatePartition(const State& s, const FullPartition& p, int limit) {
+  return ScoreBranches<State>(s, p.branches, limit, 0, AllGuesses);
+}
+
 namespace {
 
+// Scratch for one depth of PackedScoreState's recursion.
+template <int N>
+struct PackedLevel {
+  ReducedPartitionStream<N> partitions;
+  std::vector<const ReducedBranch<N>*> branches_left;
+};
+
+template <int N>
+DepthScratch<PackedLevel<N>>& PackedScratch() {
+  thread_local DepthScratch<PackedLevel<N>> scratch;
+  return scratch;
+}
+
+// `guesses` returns the live guesses of the parent of `s`, as indices into
+// `rpm`'s guesses.
 template <int N>
 ScoreResult PackedScoreState(
     const ReducedPartitions<N>& rpm,
     absl::flat_hash_map<std::array<uint64_t, N>, ScoreResult>& cache,
-    const std::array<uint64_t, N>& s, int count, int limit);
+    const std::array<uint64_t, N>& s, int count, int limit, int depth,
+    GuessesFn guesses);
 
+// `guesses` returns the live guesses of `s`, which its branches are
+// partitioned by.
 template <int N>
 int PackedScoreStatePartition(
     const ReducedPartitions<N>& rpm,
     absl::flat_hash_map<std::array<uint64_t, N>, ScoreResult>& cache,
-    const std::array<uint64_t, N>& s, int count, const ReducedGuess<N>& p,
-    int limit) {
+    const std::array<uint64_t, N>& s, int count,
+    absl::Span<const ReducedBranch<N>> branches, int limit, int depth,
+    GuessesFn guesses, std::vector<const ReducedBranch<N>*>& branches_left) {
   // The base score is one for each bit in `s`, indicating the
   // guess we're about to make.
   int score = count;
@@ -76,8 +221,8 @@ int PackedScoreStatePartition(
 
   // To enable early pruning, we first add in a lower bound value for each
   // match.  (A state with N bits has as a lower bound 2N-1 as a score.)
-  std::vector<const wordle::ReducedBranch<N>*> branches_left;
-  for (const wordle::ReducedBranch<N>& b : p.branches) {
+  branches_left.clear();
+  for (const wordle::ReducedBranch<N>& b : branches) {
     auto it = cache.find(b.mask);
     if (it == cache.end()) {
       score += 2 * b.num_bits - 1;
@@ -95,9 +240,9 @@ int PackedScoreStatePartition(
     score -= 2 * b->num_bits - 1;
     // Recursively call BestScore, subtracting out our score so far from the
     // limit that we pass to the child.
-    score +=
-        PackedScoreState<N>(rpm, cache, b->mask, b->num_bits, limit - score)
-            .first;
+    score += PackedScoreState<N>(rpm, cache, b->mask, b->num_bits,
+                                 limit - score, depth + 1, guesses)
+                 .first;
     if (score >= limit) {
       // We've hit the limit, exit early
       return kOver;
@@ -110,7 +255,8 @@ template <int N>
 ScoreResult PackedScoreState(
     const ReducedPartitions<N>& rpm,
     absl::flat_hash_map<std::array<uint64_t, N>, ScoreResult>& cache,
-    const std::array<uint64_t, N>& s, int count, int limit) {
+    const std::array<uint64_t, N>& s, int count, int limit, int depth,
+    GuessesFn guesses) {
   int simple_limit = count * 2 - 1;
   if (simple_limit >= limit) return {kOver, Word{}};
   if (count < 3) return ScoreResult{simple_limit, rpm.Exemplar(s)};
@@ -120,73 +266,101 @@ ScoreResult PackedScoreState(
     return it->second;
   }
 
-  std::vector<ReducedGuess<N>> partitions = rpm.SubPartitions(s);
+  PackedLevel<N>& level = PackedScratch<N>().at(depth);
+  rpm.StreamPartitions(s, guesses(), &level.partitions);
   ScoreResult best_so_far = {kOver, Word()};
-  for (const ReducedGuess<N>& p : partitions) {
-    int sc = PackedScoreStatePartition<N>(rpm, cache, s, count, p, limit);
+  // Partitions come in order of their lower bounds, so once one reaches the
+  // limit, every later one would be cut off too, and none is built.
+  typename ReducedPartitionStream<N>::Entry p;
+  while (level.partitions.NextBound() < limit - count &&
+         level.partitions.Next(&p)) {
+    int sc = PackedScoreStatePartition<N>(
+        rpm, cache, s, count, p.branches, limit, depth,
+        [&] { return level.partitions.live_guesses(); }, level.branches_left);
     if (sc < limit) {
       limit = sc;
       best_so_far = {sc, p.word};
     }
   }
+  CountScan(depth, level.partitions);
   if (best_so_far.first < kOver) {
     cache[s] = best_so_far;
   }
   return best_so_far;
 }
 
-ScoreResult PackedScoreState(const State& s, int limit) {
+// Scores `s`, at `depth` of ScoreState's search, partitioning it only by the
+// raw::guesses `guesses` returns.
+ScoreResult PackedScoreState(const State& s, int limit, int depth,
+                             GuessesFn guesses) {
   int count = s.count();
   if (count <= 64 * 1) {
-    ReducedPartitions<1> rpm(s);
+    ReducedPartitions<1> rpm(s, guesses());
     absl::flat_hash_map<std::array<uint64_t, 1>, ScoreResult> cache;
-    return PackedScoreState<1>(rpm, cache, rpm.FullMask(), count, limit);
+    return PackedScoreState<1>(rpm, cache, rpm.FullMask(), count, limit,
+                               depth, [&] { return rpm.all_guesses(); });
   } else if (count <= 64 * 2) {
-    ReducedPartitions<2> rpm(s);
+    ReducedPartitions<2> rpm(s, guesses());
     absl::flat_hash_map<std::array<uint64_t, 2>, ScoreResult> cache;
-    return PackedScoreState<2>(rpm, cache, rpm.FullMask(), count, limit);
+    return PackedScoreState<2>(rpm, cache, rpm.FullMask(), count, limit,
+                               depth, [&] { return rpm.all_guesses(); });
   } else if (count <= 64 * 3) {
-    ReducedPartitions<3> rpm(s);
+    ReducedPartitions<3> rpm(s, guesses());
     absl::flat_hash_map<std::array<uint64_t, 3>, ScoreResult> cache;
-    return PackedScoreState<3>(rpm, cache, rpm.FullMask(), count, limit);
+    return PackedScoreState<3>(rpm, cache, rpm.FullMask(), count, limit,
+                               depth, [&] { return rpm.all_guesses(); });
   } else if (count <= 64 * 4) {
-    ReducedPartitions<4> rpm(s);
+    ReducedPartitions<4> rpm(s, guesses());
     absl::flat_hash_map<std::array<uint64_t, 4>, ScoreResult> cache;
-    return PackedScoreState<4>(rpm, cache, rpm.FullMask(), count, limit);
+    return PackedScoreState<4>(rpm, cache, rpm.FullMask(), count, limit,
+                               depth, [&] { return rpm.all_guesses(); });
   } else {
-    return ScoreState(s, limit);
+    return ScoreState(s, limit, guesses());
   }
 }
 
-}  // namespace
-
-ScoreResult ScoreState(const State& s, int limit) {
+ScoreResult ScoreStateAtDepth(const State& s, int limit, int depth,
+                              GuessesFn guesses) {
   int simple_limit = s.count() * 2 - 1;
   if (simple_limit >= limit) return {kOver, Word{}};
   if (s.count() < 3) return ScoreResult{simple_limit, s.Exemplar()};
-  uint64_t bighash;
   if (s.count() >= kCutoff) {
-    bighash = s.Rapidash();
-    absl::MutexLock lock(&big_results_mu);
-    auto it = big_results.find(bighash);
-    if (it != big_results.end()) {
-      return it->second;
+    if (std::optional<ScoreResult> cached = FindCached(s)) {
+      return *cached;
     }
   }
   if (s.count() < 257) {
-    return PackedScoreState(s, limit);
+    return PackedScoreState(s, limit, depth, guesses);
   }
 
-  std::vector<FullPartition> partitions = SubPartitions(s);
+  PartitionStream& partitions = full_scratch.at(depth);
+  StreamPartitions(s, guesses(), &partitions);
   ScoreResult best_so_far = {kOver, Word{}};
-  for (const FullPartition& p : partitions) {
-    int sc = ScoreStatePartition(s, p, limit);
+  // As in PackedScoreState, no partition is built once the bounds reach the
+  // limit.
+  PartitionStream::Entry p;
+  while (partitions.NextBound() < limit - s.count() && partitions.Next(&p)) {
+    int sc = ScoreBranches<InternedState>(
+        s, p.branches, limit, depth,
+        [&] { return partitions.live_guesses(); });
     if (sc < limit) {
       limit = sc;
       best_so_far = {sc, p.word};
     }
   }
+  CountScan(depth, partitions);
   return best_so_far;
 }
 
+}  // namespace
+
+ScoreResult ScoreState(const State& s, int limit) {
+  return ScoreStateAtDepth(s, limit, 0, AllGuesses);
+}
+
+ScoreResult ScoreState(const State& s, int limit,
+                       absl::Span<const int> guesses) {
+  return ScoreStateAtDepth(s, limit, 0, [guesses] { return guesses; });
+}
+
 }  // namespace wordle
\ No newline at end of file
@@ -1,7 +1,11 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
+#include <vector>
 
+#include "absl/numeric/int128.h"
+#include "absl/types/span.h"
 #include "partition_map.h"
 #include "state.h"
 
@@ -13,9 +17,21 @@ using ScoreResult = std::pair<int, Word>;
 
 using CachedCallback = void (*)(const State& s, int score, const char* guess);
 
-bool AddHash(uint64_t rapidash, ScoreResult res);
+// Stored results, which ScoreState returns for states of kCutoff or more
+// targets instead of searching them.  AddHash keys a result by
+// State::Fingerprint(), and returns false if one was already stored.  The
+// first state looked up with that fingerprint claims the result, keeping its
+// StateKey; any other state sharing the fingerprint is then not cached.
+bool AddHash(absl::uint128 fingerprint, ScoreResult res);
 bool IsCached(const State& s);
 
+// As AddHash, for `::` seed lines keyed by State::Rapidash().  Each such
+// result is rekeyed by fingerprint the first time its state is looked up, and
+// passed to the callback set by SetMigratedCallback, if any, so it can be
+// written out again in the new form.
+bool AddLegacyHash(uint64_t rapidash, ScoreResult res);
+void SetMigratedCallback(CachedCallback migrated);
+
 // A number which scores can never reach.  The initial state can achieve a
 // score of 7920 through the guess `salet`.  (It's not yet known if this is
 // best, but it does present an upper bound.)
@@ -37,6 +53,12 @@ constexpr int kOver = 100000;
 // function can return values greater than kScoreLimit that are not kOver.)
 ScoreResult ScoreState(const State& s, int limit = kScoreLimit);
 
+// As above, partitioning `s` only by the guesses with these raw::guesses
+// indices, in increasing order, such as the live guesses of a parent of `s`;
+// see SubPartitions.
+ScoreResult ScoreState(const State& s, int limit,
+                       absl::Span<const int> guesses);
+
 // Calculate the score of a given state `s`, presuming the word guess `p` is
 // made.  Barring `kOver`/`limit` pruning, `ScoreState(s)` will return the
 // minimum value of `ScoreState(s, p)` over all partitions `p` from state `s`.
@@ -45,7 +67,24 @@ ScoreResult ScoreState(const State& s, int limit = kScoreLimit);
 //
 // Should not be called for states with 2 or fewer bits set.  ScoreState()
 // will short circuit in this case.
-inline int ScoreStatePartition(const State& s, const FullPartition& p,
-                               int limit);
+int ScoreStatePartition(const State& s, const FullPartition& p, int limit);
+
+// How much partitioning ScoreState has done at one depth of its searches,
+// counted from the states it was called on: the number of states it
+// partitioned there, the number of guesses it scanned for them in all, and
+// the number of those it found dominated by another and dropped from the
+// live guesses of their substates (see DominanceFilter).  Each state scans
+// only the live guesses of its parent, so the guesses per state fall with
+// depth.
+struct ScanCounts {
+  int64_t states = 0;
+  int64_t guesses = 0;
+  int64_t dominated = 0;
+};
+
+// Returns the counts at each depth since the last reset, through the deepest
+// reached.
+std::vector<ScanCounts> GetScanCounts();
+void ResetScanCounts();
 
 }  // namespace wordle
\ No newline at end of file
@@ -4,12 +4,15 @@
 #include <thread>
 
 #include "absl/time/clock.h"
+#include "absl/types/span.h"
 #include "color_guess.h"
+#include "depth_scratch.h"
 #include "folly/container/EvictingCacheMap.h"
 #include "partition_map.h"
 #include "thread_pool.h"
 #include "score.h"
 #include "state.h"
+#include "state_key.h"
 
 absl::Mutex memomap_mu;
 
@@ -18,7 +21,14 @@ struct std::hash<wordle::StateId> {
   size_t operator()(wordle::StateId id) const { return id; }
 };
 
-folly::EvictingCacheMap<wordle::StateId, int> memomap(50'000'000);
+// A memoized score, with the key of its state, since distinct states can
+// share a StateId.
+struct Memo {
+  wordle::StateKey key;
+  int score;
+};
+
+folly::EvictingCacheMap<wordle::StateId, Memo> memomap(50'000'000);
 
 int dstep[20] = {0};
 int dmax[20] = {0};
@@ -48,32 +58,36 @@ constexpr int kOver = 100000;
 // the initial state scores 7920 via `salet`
 constexpr int kScoreLimit = 7921;
 
-int BestScore(const wordle::State& s, int limit = kScoreLimit, int depth = 0);
+// `guesses` are the live guesses of `s`; see wordle::SubPartitions.
+int BestScore(const wordle::State& s, int limit, int depth,
+              absl::Span<const int> guesses);
 
-int ScorePartition(const wordle::State& s, const wordle::FullPartition& p,
-                   int depth, std::atomic<int>* limit) {
+int ScorePartition(const wordle::State& s,
+                   const wordle::PartitionList::Entry& p, int depth,
+                   std::atomic<int>* limit, absl::Span<const int> guesses) {
   int score = s.count();
-  for (const wordle::FullBranch& b : p.branches) {
+  for (const wordle::InternedBranch& b : p.branches) {
     score += 2 * b.mask.count() - 1;
   }
-  for (const wordle::FullBranch& b : p.branches) {
+  for (const wordle::InternedBranch& b : p.branches) {
     if (score >= limit->load()) {
       // We've hit the limit, exit early
       return kOver;
     }
     score -= 2 * b.mask.count() - 1;
-    score += BestScore(b.mask, limit->load() - score, depth + 1);
+    score += BestScore(b.mask, limit->load() - score, depth + 1, guesses);
   }
   return score;
 }
 
-int BestScore(const wordle::State& s, int limit, int depth) {
+int BestScore(const wordle::State& s, int limit, int depth,
+              absl::Span<const int> guesses) {
   {
     absl::MutexLock lock(&memomap_mu);
     auto it = memomap.find(s.ToStateId());
-    if (it != memomap.end()) {
+    if (it != memomap.end() && it->second.key.Matches(s)) {
       ++dcached;
-      return it->second;
+      return it->second.score;
     }
   }
   MaybeIo();
@@ -81,10 +95,11 @@ int BestScore(const wordle::State& s, int limit, int depth) {
   if (simple_limit >= limit) return kOver;
   if (s.count() < 3) return simple_limit;
   if (s.count() < 257) {
-    int res = wordle::ScoreState(s, limit).first;
+    int res = wordle::ScoreState(s, limit, guesses).first;
     if (res < limit) {
+      Memo memo{wordle::StateKey(s), res};
       absl::MutexLock lock(&memomap_mu);
-      if (memomap.insert(s.ToStateId(), res).second) {
+      if (memomap.insert(s.ToStateId(), std::move(memo)).second) {
         ++dnew;
       } else {
         ++dwasted;
@@ -95,7 +110,10 @@ int BestScore(const wordle::State& s, int limit, int depth) {
     return res;
   }
 
-  auto partitions = SubPartitions(s);
+  // Each thread reuses its partition lists from one node to the next.
+  thread_local wordle::DepthScratch<wordle::PartitionList> scratch;
+  wordle::PartitionList& partitions = scratch.at(depth);
+  SubPartitions(s, guesses, &partitions);
   dstep[depth] = 0;
   dmax[depth] = partitions.size();
   dbest[depth] = 9999;
@@ -103,26 +121,38 @@ int BestScore(const wordle::State& s, int limit, int depth) {
 
   int best_so_far = kOver;
   std::atomic<int> atomic_limit{limit};
-  std::vector<std::function<int()>> choice_functions;
-  for (int i = 0; i < int(partitions.size()); ++i) {
-    choice_functions.emplace_back([&, i] {
-      const wordle::FullPartition& p = partitions[i];
-      int sc = ScorePartition(s, p, depth, &atomic_limit);
-      if (sc < atomic_limit.load()) {
-        atomic_limit.store(sc);
-        dbest[depth] = sc;
-        dword[depth] = p.word;
-      }
-      return sc;
-    });
-  }
-  wordle::RunThreads(depth == 0 ? 32 : 1, choice_functions, [&](int score) {
+  auto choose = [&](int i) {
+    const wordle::PartitionList::Entry p = partitions[i];
+    int sc = ScorePartition(s, p, depth, &atomic_limit,
+                            partitions.live_guesses());
+    if (sc < atomic_limit.load()) {
+      atomic_limit.store(sc);
+      dbest[depth] = sc;
+      dword[depth] = p.word;
+    }
+    return sc;
+  };
+  auto chosen = [&](int score) {
     ++dstep[depth];
     best_so_far = std::min(best_so_far, score);
-  });
+  };
+  if (depth == 0) {
+    std::vector<std::function<int()>> choice_functions;
+    for (int i = 0; i < partitions.size(); ++i) {
+      choice_functions.emplace_back([&, i] { return choose(i); });
+    }
+    wordle::RunThreads(32, choice_functions, chosen);
+  } else {
+    // Deeper nodes run on one thread; calling directly avoids building a
+    // std::function per guess.
+    for (int i = 0; i < partitions.size(); ++i) {
+      chosen(choose(i));
+    }
+  }
   if (best_so_far < kOver) {
+    Memo memo{wordle::StateKey(s), best_so_far};
     absl::MutexLock lock(&memomap_mu);
-    if (memomap.insert(s.ToStateId(), best_so_far).second) {
+    if (memomap.insert(s.ToStateId(), std::move(memo)).second) {
       ++dnew;
     } else {
       ++dwasted;
@@ -147,24 +177,22 @@ void Plinko() {
 }
 
 int main() {
-  auto ps = SubPartitions(wordle::State::AllBits());
+  wordle::PartitionList ps;
+  SubPartitions(wordle::State::AllBits(), &ps);
   std::cout << ps.size() << " partitions (should be " << wordle::kDictionarySize
             << ")\n";
   int count = 0;
-  std::set<wordle::State> fb;
-  for (auto& pt : ps) {
-    count += pt.branches.size();
-    for (auto& br : pt.branches) {
-      fb.insert(std::move(br.mask));
-    }
+  for (int i = 0; i < ps.size(); ++i) {
+    count += ps[i].branches.size();
   }
   std::cout << count << " branches among them (branch factor "
             << double(count) / ps.size() << ")\n";
-  std::cout << fb.size() << " unique branches\n";
+  std::cout << ps.num_states() << " unique branches\n";
   
   std::thread t(Plinko);
   t.detach();
-  int score = BestScore(wordle::State::AllBits());
+  int score = BestScore(wordle::State::AllBits(), kScoreLimit, 0,
+                        wordle::AllGuesses());
   std::cout << "\n\n" << "best sc=" << score << "\n\n";
   std::cout << "best wd=" << dword[0] << std::endl;
 }
@@ -128,6 +128,7 @@ int main(int argc, char** argv) {
         TimeTest<1>(b.mask);
         if (branch/* && b.mask.count() < 256*/) {
           {
+            ResetScanCounts();
             auto time1 = absl::Now();
             ScoreResult score = ScoreState(b.mask);
             auto time2 = absl::Now();
@@ -135,6 +136,14 @@ int main(int argc, char** argv) {
                       << score.second << ", EV "
                       << (double(score.first) / b.mask.count()) << ", time "
                       << (time2 - time1) / absl::Milliseconds(1) << "ms\n";
+            std::vector<ScanCounts> scans = GetScanCounts();
+            for (int depth = 0; depth < int(scans.size()); ++depth) {
+              std::cout << "  depth " << depth << ": " << scans[depth].states
+                        << " states, "
+                        << double(scans[depth].guesses) / scans[depth].states
+                        << " guesses scanned per state, "
+                        << scans[depth].dominated << " dominated\n";
+            }
           }
 /*
           ReducedPartitions<4> rpm(b.mask);
@@ -5,14 +5,41 @@ namespace wordle {
 std::vector<Word> State::Words() const {
   std::vector<Word> result;
   for (int i = 0; i < kNumWords; ++i) {
-    uint64_t word = (*words_)[i];
+    uint64_t word = words_[i];
     while (word) {
       int bit_index = absl::countr_zero(word);
-      result.emplace_back(i * 64 + bit_index);
+      result.push_back(TargetAtBit(i * 64 + bit_index));
       word ^= (uint64_t{1} << bit_index);
     }
   }
   return result;
 }
 
+uint64_t State::Rapidash() const {
+  std::array<uint64_t, kNumWords> identity = {};
+  for (Word target : Words()) {
+    const int index = target.ToIndex();
+    identity[index / 64] |= uint64_t{1} << (index % 64);
+  }
+  uint64_t sh = 14695981039346656037u;
+  for (uint64_t word : identity) {
+    sh *= uint64_t{1099511628211};
+    sh ^= (word >> 32);
+    sh *= uint64_t{1099511628211};
+    sh ^= (word & uint64_t{0xffffffff});
+  }
+  return sh;
+}
+
+void SparseState::Assign(const State& s) {
+  bits_.clear();
+  for (int i = 0; i < State::kNumWords; ++i) {
+    uint64_t word = s.array()[i];
+    while (word) {
+      bits_.push_back(i * 64 + absl::countr_zero(word));
+      word &= word - 1;
+    }
+  }
+}
+
 }  // namespace wordle
\ No newline at end of file
@@ -4,11 +4,14 @@
 #include <array>
 #include <bitset>
 #include <cstdint>
-#include <memory>
+#include <vector>
 
 #include "absl/hash/hash.h"
 #include "absl/numeric/bits.h"
+#include "absl/numeric/int128.h"
+#include "absl/types/span.h"
 #include "dictionary.h"
+#include "state_kernels.h"
 
 namespace wordle {
 
@@ -16,78 +19,91 @@ using StateId = unsigned __int128;
 
 class State {
  public:
-  static constexpr int kNumWords = (kNumTargets + 63) / 64;
+  static constexpr int kNumWords = kNumStateWords;
+  static constexpr uint64_t kAllWords = (uint64_t{1} << kNumWords) - 1;
 
+  // Constructs the state holding the targets whose indices are set in `b`.
   State(const std::bitset<kNumTargets>& b) : State() {
     for (int i = 0; i < kNumTargets; ++i) {
       if (b[i]) {
-        SetBit(i);
+        SetBit(BitOfTarget(Word(i)));
       }
     }
-    bits_hash_ = absl::HashOf(*words_);
+    SetFingerprint(FingerprintWords(words_));
   }
 
-  State(const State& initial, const std::array<uint64_t, kNumWords>& m1,
-        const std::array<uint64_t, kNumWords>& m2)
-      : words_(std::make_unique<Array>()),
-        max_bit_index_(0),
-        min_bit_index_(kNumTargets),
-        num_bits_(0) {
-    for (int i = 0; i < kNumWords; ++i) {
-      uint64_t word = (*initial.words_)[i] & m1[i] & m2[i];
-      (*words_)[i] = word;
-      num_bits_ += __builtin_popcountll(word);
-      if (word != 0) {
-        max_bit_index_ = (64 * i) + 63 - absl::countl_zero(word);
-        if (min_bit_index_ == kNumTargets) {
-          min_bit_index_ = (64 * i) + absl::countr_zero(word);
-        }
-      }
-    }
-    bits_hash_ = absl::HashOf(*words_);
+  // Constructs the state whose set bits are `bits`, which must be distinct.
+  explicit State(absl::Span<const uint16_t> bits) {
+    Summarize(SetBits(bits.data(), bits.size(), &words_));
   }
 
-  State(const State&) = delete;
-  State(State&&) = default;
-  State& operator=(const State&) = delete;
-  State& operator=(State&&) = default;
+  // Constructs the intersection of `initial` with each of the `num_masks`
+  // masks in `masks`.
+  State(const State& initial,
+        const std::array<uint64_t, kNumWords>* const* masks, int num_masks) {
+    Summarize(state_kernels->and_masks(initial.words_, masks, num_masks,
+                                       &words_));
+  }
 
-  // Return an integer ID uniquely representing this state.  For two states
-  // with different count()s, the type with the higher count() has the higher
-  // StateId.  (This is intended to allow for useful sort ordering.)
+  // As above, but reading the masks in compact form.  Only words present in
+  // every mask, and set in `initial_nonzero`, are visited.  Pass
+  // initial.NonzeroWords() there to skip the zero words of `initial` when
+  // building many states from it.
+  State(const State& initial, const CompactMask* masks, int num_masks,
+        uint64_t initial_nonzero = kAllWords) {
+    Summarize(state_kernels->and_compact_masks(
+        initial.words_, initial_nonzero, masks, num_masks, &words_));
+  }
+
+  // The words are stored inline, so copying is a fixed-size memcpy and moving
+  // is the same as copying.
+  State(const State&) = default;
+  State& operator=(const State&) = default;
+
+  // Return an integer ID representing this state: its count, lowest and
+  // highest set bit and the low half of its fingerprint.  Distinct states
+  // share an id only if those all collide; where that matters, keep a
+  // StateKey to tell them apart.  For two states with different count()s, the
+  // type with the higher count() has the higher StateId.  (This is intended
+  // to allow for useful sort ordering.)
   StateId ToStateId() const {
     return (StateId(num_bits_) << 96) | (StateId(min_bit_index_) << 80) |
-           (StateId(max_bit_index_) << 64) | StateId(bits_hash_);
+           (StateId(max_bit_index_) << 64) | StateId(fingerprint_low_);
+  }
+
+  // A 128-bit hash of the words, computed on construction; ToStateId() holds
+  // its low half.  It is the same in every process, so it also keys stored
+  // results, as in `::` seed lines.  Like the words, it depends on the target
+  // order of the tables.
+  absl::uint128 Fingerprint() const {
+    return absl::MakeUint128(fingerprint_high_, fingerprint_low_);
   }
 
+  // Hashes the fingerprint, which is the same for states operator== calls
+  // equal.
   template <typename H>
   friend H AbslHashValue(H h, const State& s) {
-    return H::combine(std::move(h), s.array());
+    return H::combine(std::move(h), s.fingerprint_low_);
   }
 
-  uint64_t Rapidash() const {
-    uint64_t sh = 14695981039346656037u;
-    for (uint64_t word : *words_) {
-      sh *= uint64_t{1099511628211};
-      sh ^= (word >> 32);
-      sh *= uint64_t{1099511628211};
-      sh ^= (word & uint64_t{0xffffffff});
-    }
-    return sh;
-  }
+  // The hash `::` seed lines were keyed by before Fingerprint().  Those
+  // predate target orders, so it is taken over the words with bit i holding
+  // target i, whatever order is installed.  Only for reading old seeds; see
+  // AddLegacyHash().
+  uint64_t Rapidash() const;
 
   static State MakeAllBits() {
     State t;
     for (int i = 0; i < kNumTargets; ++i) {
       t.SetBit(i);
     }
-    t.bits_hash_ = absl::HashOf(*t.words_);
+    t.SetFingerprint(FingerprintWords(t.words_));
     return t;
   }
 
   static State MakeEmpty() {
     State t;
-    t.bits_hash_ = absl::HashOf(*t.words_);
+    t.SetFingerprint(FingerprintWords(t.words_));
     return t;
   }
 
@@ -97,54 +113,80 @@ class State {
   }
 
   friend State operator&(const State& lhs, const State& rhs) {
-    State ans;
-    ans.num_bits_ = 0;
-    ans.min_bit_index_ = kNumTargets;
-    ans.max_bit_index_ = 0;
-    for (int i = 0; i < kNumWords; ++i) {
-      uint64_t word = (*lhs.words_)[i] & (*rhs.words_)[i];
-      (*ans.words_)[i] = word;
-      ans.num_bits_ += __builtin_popcountll(word);
-      if (word != 0) {
-        ans.max_bit_index_ = (64 * i) + 63 - absl::countl_zero(word);
-        if (ans.min_bit_index_ == kNumTargets) {
-          ans.min_bit_index_ = (64 * i) + absl::countr_zero(word);
-        }
-      }
-    }
-    ans.bits_hash_ = absl::HashOf(*ans.words_);
+    State ans(Uninitialized{});
+    const Array* rhs_words = &rhs.words_;
+    ans.Summarize(
+        state_kernels->and_masks(lhs.words_, &rhs_words, 1, &ans.words_));
     return ans;
   }
 
   const char* Exemplar() const {
-    return (min_bit_index_ == kNumTargets) ? "NONE"
-                                           : Word(min_bit_index_).ToString();
+    return (min_bit_index_ == kNumTargets)
+               ? "NONE"
+               : TargetAtBit(min_bit_index_).ToString();
+  }
+  const char* Exemplar2() const {
+    return TargetAtBit(max_bit_index_).ToString();
   }
-  const char* Exemplar2() const { return Word(max_bit_index_).ToString(); }
   std::vector<Word> Words() const;
 
+  // Returns a mask with bit `i` set iff word `i` is nonzero.  Most states of
+  // a few hundred targets still touch 30 or more of the words, so this is
+  // computed when asked for rather than stored.
+  uint64_t NonzeroWords() const {
+    uint64_t nonzero = 0;
+    for (int i = 0; i < kNumWords; ++i) {
+      nonzero |= uint64_t{words_[i] != 0} << i;
+    }
+    return nonzero;
+  }
+
   int count() const { return num_bits_; }
   bool empty() const { return num_bits_ == 0; }
 
-  bool operator==(const State& r) const { return ToStateId() == r.ToStateId(); }
-  bool operator!=(const State& r) const { return ToStateId() != r.ToStateId(); }
-  bool operator<(const State& r) const { return ToStateId() < r.ToStateId(); }
-  bool operator<=(const State& r) const { return ToStateId() <= r.ToStateId(); }
-  bool operator>(const State& r) const { return ToStateId() > r.ToStateId(); }
-  bool operator>=(const State& r) const { return ToStateId() >= r.ToStateId(); }
+  // States are ordered by StateId, and compare their words only when the ids
+  // are equal, so distinct states never compare equal even if their
+  // fingerprints collide.
+  bool operator==(const State& r) const {
+    return ToStateId() == r.ToStateId() && words_ == r.words_;
+  }
+  bool operator!=(const State& r) const { return !(*this == r); }
+  bool operator<(const State& r) const {
+    const StateId id = ToStateId();
+    const StateId r_id = r.ToStateId();
+    return id != r_id ? id < r_id : words_ < r.words_;
+  }
+  bool operator<=(const State& r) const { return !(r < *this); }
+  bool operator>(const State& r) const { return r < *this; }
+  bool operator>=(const State& r) const { return !(*this < r); }
 
   using Array = std::array<uint64_t, kNumWords>;
-  const Array& array() const { return *words_; }
+  const Array& array() const { return words_; }
 
  private:
-  State() : words_(std::make_unique<Array>()), num_bits_(0) {
-    std::fill(words_->begin(), words_->end(), uint64_t{0});
+  State() : num_bits_(0) { words_.fill(0); }
+
+  // Leaves the words for the caller to fill in, followed by Summarize().
+  struct Uninitialized {};
+  State(Uninitialized) {}
+
+  // Sets the cached fields from the words and their summary.
+  void Summarize(const WordsSummary& summary) {
+    num_bits_ = summary.num_bits;
+    min_bit_index_ = summary.min_bit_index;
+    max_bit_index_ = summary.max_bit_index;
+    SetFingerprint(summary.fingerprint);
+  }
+
+  void SetFingerprint(absl::uint128 fingerprint) {
+    fingerprint_low_ = absl::Uint128Low64(fingerprint);
+    fingerprint_high_ = absl::Uint128High64(fingerprint);
   }
 
   void SetBit(int idx) {
     const int word_idx = idx / 64;
     const int pos_idx = idx % 64;
-    uint64_t& word = (*words_)[word_idx];
+    uint64_t& word = words_[word_idx];
     const uint64_t mask = uint64_t{1} << pos_idx;
     if (!(word & mask)) {
       word |= mask;
@@ -154,16 +196,33 @@ class State {
     max_bit_index_ = std::max<uint16_t>(max_bit_index_, idx);
   }
 
-  std::unique_ptr<Array> words_;
+  Array words_;
 
-  // We cheat here by assuming sequences with equal hashes are equal
-  // (so long as the other three fields are equal too).
-  //
   // This order of fields allows for fast StateId generation speed on x86.
-  uint64_t bits_hash_ = 0;
+  uint64_t fingerprint_low_ = 0;
   uint16_t max_bit_index_ = 0;
   uint16_t min_bit_index_ = kNumTargets;
   uint32_t num_bits_;
+  uint64_t fingerprint_high_ = 0;
+};
+
+// The set bits of a State, in increasing order.  For a state with few
+// targets, visiting each of them is cheaper than visiting all the words; see
+// SubPartitions.  Assign() reuses the list's buffer.
+class SparseState {
+ public:
+  SparseState() = default;
+  explicit SparseState(const State& s) { Assign(s); }
+
+  void Assign(const State& s);
+
+  int count() const { return bits_.size(); }
+  absl::Span<const uint16_t> bits() const { return bits_; }
+
+  State ToState() const { return State(absl::MakeConstSpan(bits_)); }
+
+ private:
+  std::vector<uint16_t> bits_;
 };
 
 // A thin state is like State, but with its bitmask collapsed to a much smaller
@@ -1,36 +1,42 @@
+#include <atomic>
+#include <cstring>
 #include <optional>
 #include <string_view>
 #include <thread>
+#include <vector>
 
 #include "partition_map.h"
 #include "state.h"
 #include "score.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/numeric/int128.h"
+#include "absl/strings/numbers.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 
 using namespace wordle;
 
+// Writes the seed line for `s`, as read back by main().
+void PrintSeed(const State& s, int score, const char* guess) {
+  const absl::uint128 fingerprint = s.Fingerprint();
+  printf(":: %016lx%016lx %d %s\n", absl::Uint128High64(fingerprint),
+         absl::Uint128Low64(fingerprint), score, guess);
+  fflush(stdout);
+}
+
+// The most targets among the states partitioned in one batch, which keeps
+// the batch's branch masks to a few hundred MB.
+constexpr int kBatchTargets = 4096;
+
 // low_len and high_len are inclusive
 void concoct(int num_threads, int low_len, int high_len, unsigned bin_begin,
              unsigned bin_end, unsigned num_bins) {
-  std::set<wordle::State> all_masks;
-  int full_count = 0;
-  for (FullPartition& p : SubPartitions(wordle::State::AllBits())) {
-    full_count += p.branches.size();
-    for (FullBranch& b : p.branches) {
-      all_masks.emplace(std::move(b.mask));
-    }
-  }
-  while ((*all_masks.begin()).count() < low_len) {
-    all_masks.erase(all_masks.begin());
-  }
-
   struct LockedStates {
     absl::Mutex mu;
     absl::flat_hash_set<wordle::State> s;
   };
   std::deque<LockedStates> sm;
-  absl::flat_hash_set<uint64_t> rapidash;
+  absl::flat_hash_set<absl::uint128> fingerprints;
   sm.resize(kNumTargets + 1);
 
   absl::Mutex every_state_mu;
@@ -38,60 +44,72 @@ void concoct(int num_threads, int low_len, int high_len, unsigned bin_begin,
 
   sm[kNumTargets].s.insert(State::MakeAllBits());
   int counted = 0;
+  PartitionBatch batch;
 
   while (!sm.empty()) {
     if (sm.back().s.empty()) {
       sm.pop_back();
       continue;
     }
-    absl::Mutex current_items_mu;
-    absl::flat_hash_set<wordle::State> current_items = std::move(sm.back().s);
+    absl::flat_hash_set<wordle::State> current_set = std::move(sm.back().s);
     sm.pop_back();
+    std::vector<wordle::State> current_items;
+    current_items.reserve(current_set.size());
+    while (!current_set.empty()) {
+      current_items.push_back(
+          std::move(current_set.extract(current_set.begin()).value()));
+    }
     int current_size = sm.size();
-    std::vector<std::thread> threads;
     int work_units = 0;
-    for (int i = 0; i < num_threads; ++i) {
-      threads.emplace_back([&]{
-        while (true) {
-          std::optional<wordle::State> s;
-          {
-            absl::MutexLock lock(&current_items_mu);
-            if (current_items.empty()) {
-              return;
-            }
-            s = std::move(current_items.extract(current_items.begin()).value());
-            auto ins = rapidash.insert(s->Rapidash());
-            if (!ins.second) {
-              printf("\n\nCollision at %lx\n\n", *ins.first);
-              exit(1);
-            }
-            ++counted;
-          }
-          for (const State& mask : all_masks) {
-            State combined = mask & *s;
-            if (combined.count() >= low_len &&
-                combined.count() < current_size) {
+    for (const State& s : current_items) {
+      // The sets compare states exactly, so a repeated fingerprint is two
+      // states that share it.  Both are still counted.
+      auto ins = fingerprints.insert(s.Fingerprint());
+      if (!ins.second) {
+        fprintf(stderr, "\nFingerprint collision at %016lx%016lx\n",
+                absl::Uint128High64(*ins.first),
+                absl::Uint128Low64(*ins.first));
+      }
+      ++counted;
+      unsigned this_bin = absl::Uint128Low64(s.Fingerprint()) % num_bins;
+      if (s.count() >= low_len && s.count() <= high_len &&
+          this_bin >= bin_begin && this_bin < bin_end && !IsCached(s)) {
+        every_state.push_back(s);
+        ++work_units;
+      }
+    }
+    // The states each one leads to are its branches by every guess.
+    for (size_t begin = 0; begin < current_items.size();) {
+      size_t end = begin;
+      for (int targets = 0;
+           end < current_items.size() && targets < kBatchTargets; ++end) {
+        targets += current_items[end].count();
+      }
+      SubPartitionsBatch(
+          absl::MakeConstSpan(current_items).subspan(begin, end - begin),
+          low_len, num_threads, &batch);
+      std::atomic<int> next_input{0};
+      std::vector<std::thread> threads;
+      for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&]{
+          for (int input = next_input++; input < batch.num_inputs();
+               input = next_input++) {
+            for (InternedState combined : batch.states(input)) {
               absl::MutexLock lock(&sm[combined.count()].mu);
-              sm[combined.count()].s.insert(std::move(combined));
+              sm[combined.count()].s.insert(*combined);
             }
           }
-          unsigned this_bin = s->Rapidash() % num_bins;
-          if (s->count() >= low_len && s->count() <= high_len &&
-              this_bin >= bin_begin && this_bin < bin_end && !IsCached(*s)) {
-            absl::MutexLock lock(&every_state_mu);
-            every_state.push_back(*std::move(s));
-            ++work_units;
-          }
-        }
-      });
-    }
-    for (int i = 0; i < num_threads; ++i) {
-      threads[i].join();
+        });
+      }
+      for (int i = 0; i < num_threads; ++i) {
+        threads[i].join();
+      }
+      begin = end;
     }
     fprintf(
         stderr,
-        "% 8d counted, % 2d duplicates, size %4d\n",
-        counted, int(counted - rapidash.size()), current_size);
+        "% 8d counted, % 2d fingerprint collisions, size %4d\n",
+        counted, int(counted - fingerprints.size()), current_size);
     if (work_units > 0) {
       fprintf(stderr, "  % 8d work units enqueued\n", work_units);
     }
@@ -123,12 +141,10 @@ void concoct(int num_threads, int low_len, int high_len, unsigned bin_begin,
           every_state.pop_back();
         }
         ScoreResult sr = ScoreState(*s);
-        AddHash(s->Rapidash(), sr);
+        AddHash(s->Fingerprint(), sr);
         {
           absl::MutexLock lock(&every_state_mu);
-          printf(":: %016lx %d %s\n", s->Rapidash(), sr.first,
-                sr.second.ToString());
-          fflush(stdout);
+          PrintSeed(*s, sr.first, sr.second.ToString());
           ++number_complete;
           double percent = 100.0 * number_complete / number_in_work;
           fprintf(stderr, "%7d/%7d %02.3f%%\r", number_complete, number_in_work,
@@ -162,18 +178,28 @@ int main(int argc, char** argv) {
         << " <threads> <low_len> <high_len> <bin_begin> <bin_end> <num_bins>\n";
     return 1;
   }
+  // Seed lines are ":: <key> <score> <guess>", keyed by State::Fingerprint()
+  // in 32 hex digits.  Older lines are keyed by State::Rapidash() in 16; each
+  // is printed again with its fingerprint once its state is reached.  Old
+  // lines match under any target order, but fingerprints depend on it, so
+  // new lines only match tables with the order they were written under.
+  // States are assigned to bins by the low 64 bits of their fingerprints,
+  // where older versions used Rapidash(), so splitting a run across bins
+  // needs the same version and tables throughout.
   std::cerr << "Reading seed data\n";
   int count = 0;
+  int legacy_count = 0;
   while (std::cin) {
     std::string line;
     std::getline(std::cin, line);
     if (line.empty() || line[0] != ':') {
       break;
     }
-    uint64_t hash;
+    char key[33];
     int score;
     char word[6] = ".....";
-    if (sscanf(line.c_str(), ":: %lx %d %5c", &hash, &score, word) != 3) {
+    if (sscanf(line.c_str(), ":: %32[0-9a-f] %d %5c", key, &score, word) !=
+        3) {
       std::cerr << "failed on " << line << "\n";
       break;
     }
@@ -182,12 +208,28 @@ int main(int argc, char** argv) {
       std::cerr << "failed on " << line << "\n";
       break;
     }
-    if (!AddHash(hash, ScoreResult{score, word})) {
+    bool added;
+    if (strlen(key) > 16) {
+      absl::uint128 fingerprint;
+      added = absl::SimpleHexAtoi(key, &fingerprint) &&
+              AddHash(fingerprint, ScoreResult{score, word});
+    } else {
+      uint64_t rapidash;
+      added = absl::SimpleHexAtoi(key, &rapidash) &&
+              AddLegacyHash(rapidash, ScoreResult{score, word});
+      ++legacy_count;
+    }
+    if (!added) {
       std::cerr << "failed to insert " << line << "\n";
       break;
     }
     ++count;
   }
-  std::cerr << count << " seeds read\n";
+  std::cerr << count << " seeds read";
+  if (legacy_count > 0) {
+    std::cerr << ", " << legacy_count << " in the old form";
+    SetMigratedCallback(PrintSeed);
+  }
+  std::cerr << "\n";
   concoct(threads, low_len, high_len, bin_begin, bin_end, num_bins);
 }
\ No newline at end of file
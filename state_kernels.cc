@@ -0,0 +1,499 @@
+#include "state_kernels.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "absl/numeric/bits.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace wordle {
+
+namespace {
+
+static_assert(kNumStateWords <= 64, "nonzero word masks are one uint64_t");
+
+// The fingerprint is the accumulate and merge steps of XXH3's 128-bit hash
+// for long inputs, with our own keys, over the words padded with zeros to
+// kHashWords.  Word `i` goes to lane `i % 8` of eight 64-bit accumulators:
+//   keyed = word ^ key[i]
+//   lanes[i % 8] += low32(keyed) * high32(keyed)
+//   lanes[(i % 8) ^ 1] += word
+// Additions commute, so the vector kernels get the same lanes by updating
+// four or eight of them at once.  The input is shorter than an XXH3 block, so
+// there is no scrambling step.
+//
+// The helpers the kernels use are all inlined.  GCC does not always clear
+// the upper vector registers before an AVX kernel calls a function compiled
+// without AVX, and the transition penalty then made the kernels several
+// times slower.
+constexpr int kHashLanes = 8;
+constexpr int kHashWords = (kNumStateWords + 7) / 8 * 8;
+
+struct HashKeys {
+  uint64_t words[kHashWords];
+  uint64_t merge[2 * kHashLanes];
+};
+
+constexpr uint64_t SplitMix64(uint64_t* state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+  return z ^ (z >> 31);
+}
+
+constexpr HashKeys MakeHashKeys() {
+  HashKeys keys = {};
+  uint64_t state = kNumStateWords;
+  for (uint64_t& key : keys.words) {
+    key = SplitMix64(&state);
+  }
+  for (uint64_t& key : keys.merge) {
+    key = SplitMix64(&state);
+  }
+  return keys;
+}
+
+// Changing any of these changes every fingerprint, and with them the keys of
+// stored results.
+alignas(64) constexpr HashKeys kHashKeys = MakeHashKeys();
+alignas(64) constexpr uint64_t kInitialLanes[kHashLanes] = {
+    0x00000000c2b2ae3d, 0x9e3779b185ebca87, 0xc2b2ae3d27d4eb4f,
+    0x165667b19e3779f9, 0x85ebca77c2b2ae63, 0x0000000085ebca77,
+    0x27d4eb2f165667c5, 0x000000009e3779b1};
+
+constexpr uint64_t KeyedProduct(int i, uint64_t word) {
+  const uint64_t keyed = word ^ kHashKeys.words[i];
+  return (keyed & 0xffffffff) * (keyed >> 32);
+}
+
+__attribute__((always_inline)) inline void HashWord(int i, uint64_t word, uint64_t* lanes) {
+  lanes[i % kHashLanes] += KeyedProduct(i, word);
+  lanes[(i % kHashLanes) ^ 1] += word;
+}
+
+struct Lanes {
+  uint64_t lanes[kHashLanes];
+};
+
+// The lanes after hashing kHashWords zero words.  The compact kernels start
+// from these and adjust them for each word they write.
+constexpr Lanes MakeZeroLanes() {
+  Lanes zero = {};
+  for (int l = 0; l < kHashLanes; ++l) {
+    zero.lanes[l] = kInitialLanes[l];
+  }
+  for (int i = 0; i < kHashWords; ++i) {
+    zero.lanes[i % kHashLanes] += KeyedProduct(i, 0);
+  }
+  return zero;
+}
+alignas(64) constexpr Lanes kZeroLanes = MakeZeroLanes();
+
+// Changes `lanes`, which hashed a zero as word `i`, to hash `word` instead.
+__attribute__((always_inline)) inline void RehashZeroWord(int i, uint64_t word, uint64_t* lanes) {
+  lanes[i % kHashLanes] += KeyedProduct(i, word) - KeyedProduct(i, 0);
+  lanes[(i % kHashLanes) ^ 1] += word;
+}
+
+__attribute__((always_inline)) inline uint64_t Mul128Fold64(uint64_t a, uint64_t b) {
+  const unsigned __int128 product = (unsigned __int128)a * b;
+  return uint64_t(product) ^ uint64_t(product >> 64);
+}
+
+__attribute__((always_inline)) inline uint64_t Avalanche(uint64_t h) {
+  h ^= h >> 37;
+  h *= 0x165667919e3779f9;
+  return h ^ (h >> 32);
+}
+
+__attribute__((always_inline)) inline uint64_t MergeLanes(
+    const uint64_t* lanes, const uint64_t* keys, uint64_t start) {
+  uint64_t h = start;
+  for (int l = 0; l < kHashLanes; l += 2) {
+    h += Mul128Fold64(lanes[l] ^ keys[l], lanes[l + 1] ^ keys[l + 1]);
+  }
+  return Avalanche(h);
+}
+
+__attribute__((always_inline)) inline absl::uint128 FinishHash(
+    const uint64_t* lanes) {
+  constexpr uint64_t kBytes = 8 * kNumStateWords;
+  return absl::MakeUint128(
+      MergeLanes(lanes, kHashKeys.merge + kHashLanes,
+                 ~(kBytes * 0xc2b2ae3d27d4eb4f)),
+      MergeLanes(lanes, kHashKeys.merge, kBytes * 0x9e3779b185ebca87));
+}
+
+// Returns the summary of `words`, given its bit count, a mask with bit `i`
+// set iff word `i` is nonzero, and its finished hash lanes.
+__attribute__((always_inline)) inline WordsSummary Summarize(
+    const StateWords& words, uint64_t nonzero, uint32_t num_bits,
+    const uint64_t* lanes) {
+  if (nonzero == 0) {
+    return {FinishHash(lanes), 0, kNumTargets, 0};
+  }
+  const int lo = absl::countr_zero(nonzero);
+  const int hi = 63 - absl::countl_zero(nonzero);
+  return {FinishHash(lanes), num_bits,
+          uint16_t(64 * lo + absl::countr_zero(words[lo])),
+          uint16_t(64 * hi + 63 - absl::countl_zero(words[hi]))};
+}
+
+// The portable loops.  These are always inlined, so the kernels below that
+// reuse them are compiled for their own instruction sets.
+__attribute__((always_inline)) inline WordsSummary AndMasksScalar(
+    const StateWords& initial, const StateWords* const* masks, int num_masks,
+    StateWords* out) {
+  Lanes hash = {};
+  std::copy(kInitialLanes, kInitialLanes + kHashLanes, hash.lanes);
+  uint64_t nonzero = 0;
+  uint32_t num_bits = 0;
+  for (int i = 0; i < kNumStateWords; ++i) {
+    uint64_t word = initial[i];
+    for (int m = 0; m < num_masks; ++m) {
+      word &= (*masks[m])[i];
+    }
+    (*out)[i] = word;
+    num_bits += absl::popcount(word);
+    nonzero |= uint64_t{word != 0} << i;
+    HashWord(i, word, hash.lanes);
+  }
+  for (int i = kNumStateWords; i < kHashWords; ++i) {
+    HashWord(i, 0, hash.lanes);
+  }
+  return Summarize(*out, nonzero, num_bits, hash.lanes);
+}
+
+// Only words nonzero in `initial` and present in every mask are visited.
+__attribute__((always_inline)) inline WordsSummary AndCompactMasksScalar(
+    const StateWords& initial, uint64_t initial_nonzero,
+    const CompactMask* masks, int num_masks, StateWords* out) {
+  uint64_t present = initial_nonzero;
+  for (int m = 0; m < num_masks; ++m) {
+    present &= masks[m].present;
+  }
+  out->fill(0);
+  Lanes hash = kZeroLanes;
+  uint64_t nonzero = 0;
+  uint32_t num_bits = 0;
+  while (present) {
+    const int i = absl::countr_zero(present);
+    const uint64_t below = (uint64_t{1} << i) - 1;
+    present &= present - 1;
+    uint64_t word = initial[i];
+    for (int m = 0; m < num_masks; ++m) {
+      word &= masks[m].words[absl::popcount(masks[m].present & below)];
+    }
+    (*out)[i] = word;
+    num_bits += absl::popcount(word);
+    nonzero |= uint64_t{word != 0} << i;
+    RehashZeroWord(i, word, hash.lanes);
+  }
+  return Summarize(*out, nonzero, num_bits, hash.lanes);
+}
+
+WordsSummary AndMasksGeneric(const StateWords& initial,
+                             const StateWords* const* masks, int num_masks,
+                             StateWords* out) {
+  return AndMasksScalar(initial, masks, num_masks, out);
+}
+
+WordsSummary AndCompactMasksGeneric(const StateWords& initial,
+                                    uint64_t initial_nonzero,
+                                    const CompactMask* masks, int num_masks,
+                                    StateWords* out) {
+  return AndCompactMasksScalar(initial, initial_nonzero, masks, num_masks,
+                               out);
+}
+
+constexpr StateKernels kGenericKernels = {"generic", AndMasksGeneric,
+                                          AndCompactMasksGeneric};
+
+#if defined(__x86_64__)
+
+#define AVX2_TARGET __attribute__((target("avx2,popcnt,bmi")))
+#define AVX512_TARGET \
+  __attribute__((target("avx512f,avx512vpopcntdq,popcnt,bmi")))
+
+constexpr int kAvx2Vectors = kNumStateWords / 4;
+
+// Returns four hash lanes updated with four words and their keys.
+AVX2_TARGET inline __m256i HashVectorAvx2(__m256i lanes, __m256i words,
+                                          const uint64_t* keys) {
+  const __m256i keyed = _mm256_xor_si256(
+      words, _mm256_load_si256(reinterpret_cast<const __m256i*>(keys)));
+  const __m256i products =
+      _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32));
+  return _mm256_add_epi64(
+      lanes, _mm256_add_epi64(products, _mm256_shuffle_epi32(words, 0x4e)));
+}
+
+// Four words per vector, with the last kNumStateWords % 4 words done one at
+// a time.  AVX2 has no 64-bit popcount, so each vector's bytes are counted
+// with a nibble lookup table and summed into its four lanes.  Even vectors
+// hash into lanes 0-3 and odd ones into lanes 4-7.
+AVX2_TARGET WordsSummary AndMasksAvx2(const StateWords& initial,
+                                      const StateWords* const* masks,
+                                      int num_masks, StateWords* out) {
+  const __m256i lookup =
+      _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1,
+                       2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i hash[2] = {
+      _mm256_load_si256(reinterpret_cast<const __m256i*>(kInitialLanes)),
+      _mm256_load_si256(reinterpret_cast<const __m256i*>(kInitialLanes + 4))};
+  __m256i counts = zero;
+  uint64_t nonzero = 0;
+  for (int v = 0; v < kAvx2Vectors; ++v) {
+    __m256i acc = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(initial.data() + 4 * v));
+    for (int m = 0; m < num_masks; ++m) {
+      acc = _mm256_and_si256(acc, _mm256_loadu_si256(
+                                      reinterpret_cast<const __m256i*>(
+                                          masks[m]->data() + 4 * v)));
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out->data() + 4 * v), acc);
+    const __m256i is_zero = _mm256_cmpeq_epi64(acc, zero);
+    nonzero |= uint64_t(~_mm256_movemask_pd(_mm256_castsi256_pd(is_zero)) & 0xf)
+               << (4 * v);
+    const __m256i byte_counts = _mm256_add_epi8(
+        _mm256_shuffle_epi8(lookup, _mm256_and_si256(acc, low_nibbles)),
+        _mm256_shuffle_epi8(
+            lookup,
+            _mm256_and_si256(_mm256_srli_epi16(acc, 4), low_nibbles)));
+    counts = _mm256_add_epi64(counts, _mm256_sad_epu8(byte_counts, zero));
+    hash[v % 2] = HashVectorAvx2(hash[v % 2], acc, kHashKeys.words + 4 * v);
+  }
+  uint32_t num_bits = _mm256_extract_epi64(counts, 0) +
+                      _mm256_extract_epi64(counts, 1) +
+                      _mm256_extract_epi64(counts, 2) +
+                      _mm256_extract_epi64(counts, 3);
+  alignas(32) Lanes lanes;
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes.lanes), hash[0]);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lanes.lanes + 4), hash[1]);
+  for (int i = 4 * kAvx2Vectors; i < kNumStateWords; ++i) {
+    uint64_t word = initial[i];
+    for (int m = 0; m < num_masks; ++m) {
+      word &= (*masks[m])[i];
+    }
+    (*out)[i] = word;
+    num_bits += _mm_popcnt_u64(word);
+    nonzero |= uint64_t{word != 0} << i;
+    HashWord(i, word, lanes.lanes);
+  }
+  for (int i = kNumStateWords; i < kHashWords; ++i) {
+    HashWord(i, 0, lanes.lanes);
+  }
+  return Summarize(*out, nonzero, num_bits, lanes.lanes);
+}
+
+// AVX2 cannot expand compact words into place, so this is the portable loop
+// with POPCNT and TZCNT in place of the library calls.
+AVX2_TARGET WordsSummary AndCompactMasksAvx2(const StateWords& initial,
+                                             uint64_t initial_nonzero,
+                                             const CompactMask* masks,
+                                             int num_masks, StateWords* out) {
+  return AndCompactMasksScalar(initial, initial_nonzero, masks, num_masks,
+                               out);
+}
+
+constexpr StateKernels kAvx2Kernels = {"avx2", AndMasksAvx2,
+                                       AndCompactMasksAvx2};
+
+constexpr int kAvx512Vectors = kHashWords / 8;
+
+// The lanes of vector `v` that hold words of a State.
+constexpr __mmask8 Avx512Lanes(int v) {
+  return 8 * (v + 1) <= kNumStateWords
+             ? 0xff
+             : __mmask8((1u << (kNumStateWords - 8 * v)) - 1);
+}
+
+// GCC 12's unmasked forms of some AVX-512 intrinsics start from an
+// uninitialized vector and trip -Wmaybe-uninitialized, so the kernels use the
+// zero-masked forms with every lane selected.
+constexpr __mmask8 kAllLanes = 0xff;
+
+// Returns low32(x) * high32(x) for each lane of `x`.
+AVX512_TARGET inline __m512i HalvesProduct(__m512i x) {
+  return _mm512_maskz_mul_epu32(kAllLanes, x,
+                                _mm512_maskz_srli_epi64(kAllLanes, x, 32));
+}
+
+// Returns `x` with the 32-bit halves of each lane swapped.
+AVX512_TARGET inline __m512i SwapHalves(__m512i x) {
+  return _mm512_maskz_shuffle_epi32(__mmask16(0xffff), x, _MM_PERM_BADC);
+}
+
+// Returns the sum of the lanes of `counts`.  (GCC's _mm512_reduce_add_epi64
+// trips -Wmaybe-uninitialized too.)
+AVX512_TARGET uint32_t SumLanes(__m512i counts) {
+  alignas(64) uint64_t lanes[8];
+  _mm512_store_si512(lanes, counts);
+  uint32_t sum = 0;
+  for (uint64_t lane : lanes) {
+    sum += lane;
+  }
+  return sum;
+}
+
+// Eight words per vector, with the last vector's loads and store masked to
+// the words that exist.  The masked loads zero the padding words the hash
+// expects.
+AVX512_TARGET WordsSummary AndMasksAvx512(const StateWords& initial,
+                                          const StateWords* const* masks,
+                                          int num_masks, StateWords* out) {
+  __m512i hash = _mm512_load_si512(kInitialLanes);
+  __m512i counts = _mm512_setzero_si512();
+  uint64_t nonzero = 0;
+  for (int v = 0; v < kAvx512Vectors; ++v) {
+    const __mmask8 lanes = Avx512Lanes(v);
+    __m512i acc = _mm512_maskz_loadu_epi64(lanes, initial.data() + 8 * v);
+    for (int m = 0; m < num_masks; ++m) {
+      acc = _mm512_and_si512(
+          acc, _mm512_maskz_loadu_epi64(lanes, masks[m]->data() + 8 * v));
+    }
+    _mm512_mask_storeu_epi64(out->data() + 8 * v, lanes, acc);
+    nonzero |= uint64_t{_mm512_test_epi64_mask(acc, acc)} << (8 * v);
+    counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(acc));
+    const __m512i keyed =
+        _mm512_xor_si512(acc, _mm512_load_si512(kHashKeys.words + 8 * v));
+    hash = _mm512_add_epi64(
+        hash, _mm512_add_epi64(HalvesProduct(keyed), SwapHalves(acc)));
+  }
+  alignas(64) Lanes hash_lanes;
+  _mm512_store_si512(hash_lanes.lanes, hash);
+  return Summarize(*out, nonzero, SumLanes(counts), hash_lanes.lanes);
+}
+
+// Each mask's compact words are expanded into the lanes its `present` bits
+// name, which zeroes the rest, so no words are looked up one at a time.
+// Vectors holding no word to visit are stored as zeros without reading the
+// masks, and left as zeros in the hash.
+AVX512_TARGET WordsSummary AndCompactMasksAvx512(const StateWords& initial,
+                                                 uint64_t initial_nonzero,
+                                                 const CompactMask* masks,
+                                                 int num_masks,
+                                                 StateWords* out) {
+  uint64_t present = initial_nonzero;
+  for (int m = 0; m < num_masks; ++m) {
+    present &= masks[m].present;
+  }
+  __m512i hash = _mm512_load_si512(kZeroLanes.lanes);
+  __m512i counts = _mm512_setzero_si512();
+  uint64_t nonzero = 0;
+  for (int v = 0; v < kAvx512Vectors; ++v) {
+    const __mmask8 lanes = Avx512Lanes(v);
+    const __mmask8 vector_present = __mmask8(present >> (8 * v));
+    __m512i acc = _mm512_setzero_si512();
+    if (vector_present != 0) {
+      const uint64_t below = (uint64_t{1} << (8 * v)) - 1;
+      acc = _mm512_maskz_loadu_epi64(vector_present, initial.data() + 8 * v);
+      for (int m = 0; m < num_masks; ++m) {
+        acc = _mm512_and_si512(
+            acc, _mm512_maskz_expandloadu_epi64(
+                     __mmask8(masks[m].present >> (8 * v)),
+                     masks[m].words +
+                         _mm_popcnt_u64(masks[m].present & below)));
+      }
+      nonzero |= uint64_t{_mm512_test_epi64_mask(acc, acc)} << (8 * v);
+      counts = _mm512_add_epi64(counts, _mm512_popcnt_epi64(acc));
+      const __m512i keys = _mm512_load_si512(kHashKeys.words + 8 * v);
+      const __m512i rehash = _mm512_sub_epi64(
+          _mm512_add_epi64(HalvesProduct(_mm512_xor_si512(acc, keys)),
+                           SwapHalves(acc)),
+          HalvesProduct(keys));
+      hash = _mm512_add_epi64(hash, rehash);
+    }
+    _mm512_mask_storeu_epi64(out->data() + 8 * v, lanes, acc);
+  }
+  alignas(64) Lanes hash_lanes;
+  _mm512_store_si512(hash_lanes.lanes, hash);
+  return Summarize(*out, nonzero, SumLanes(counts), hash_lanes.lanes);
+}
+
+constexpr StateKernels kAvx512Kernels = {"avx512", AndMasksAvx512,
+                                         AndCompactMasksAvx512};
+
+#endif  // defined(__x86_64__)
+
+// Returns the kernel sets this CPU can run, best first.
+std::vector<const StateKernels*> SupportedKernels() {
+  std::vector<const StateKernels*> supported;
+#if defined(__x86_64__)
+  // Needed before main().
+  __builtin_cpu_init();
+  const bool avx2 = __builtin_cpu_supports("avx2") &&
+                    __builtin_cpu_supports("popcnt") &&
+                    __builtin_cpu_supports("bmi");
+  if (avx2 && __builtin_cpu_supports("avx512f") &&
+      __builtin_cpu_supports("avx512vpopcntdq")) {
+    supported.push_back(&kAvx512Kernels);
+  }
+  if (avx2) {
+    supported.push_back(&kAvx2Kernels);
+  }
+#endif
+  supported.push_back(&kGenericKernels);
+  return supported;
+}
+
+const StateKernels* ChooseKernels() {
+  const std::vector<const StateKernels*> supported = SupportedKernels();
+  const char* name = getenv("WORDLE_STATE_KERNELS");
+  if (name == nullptr || *name == '\0') {
+    return supported.front();
+  }
+  for (const StateKernels* kernels : supported) {
+    if (strcmp(kernels->name, name) == 0) {
+      return kernels;
+    }
+  }
+  fprintf(stderr, "$WORDLE_STATE_KERNELS: %s is not supported; using %s\n",
+          name, supported.front()->name);
+  return supported.front();
+}
+
+}  // namespace
+
+absl::uint128 FingerprintWords(const StateWords& words) {
+  Lanes hash = {};
+  std::copy(kInitialLanes, kInitialLanes + kHashLanes, hash.lanes);
+  for (int i = 0; i < kHashWords; ++i) {
+    HashWord(i, i < kNumStateWords ? words[i] : 0, hash.lanes);
+  }
+  return FinishHash(hash.lanes);
+}
+
+WordsSummary SetBits(const uint16_t* bits, int num_bits, StateWords* out) {
+  out->fill(0);
+  uint64_t nonzero = 0;
+  for (int b = 0; b < num_bits; ++b) {
+    (*out)[bits[b] / 64] |= uint64_t{1} << (bits[b] % 64);
+    nonzero |= uint64_t{1} << (bits[b] / 64);
+  }
+  Lanes hash = kZeroLanes;
+  for (uint64_t words = nonzero; words != 0; words &= words - 1) {
+    const int i = absl::countr_zero(words);
+    RehashZeroWord(i, (*out)[i], hash.lanes);
+  }
+  return Summarize(*out, nonzero, num_bits, hash.lanes);
+}
+
+const StateKernels* state_kernels = &kGenericKernels;
+
+namespace {
+
+[[maybe_unused]] const bool state_kernels_chosen =
+    (state_kernels = ChooseKernels(), true);
+
+}  // namespace
+
+}  // namespace wordle
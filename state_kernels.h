@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "absl/numeric/int128.h"
+#include "dictionary.h"
+
+namespace wordle {
+
+constexpr int kNumStateWords = (kNumTargets + 63) / 64;
+using StateWords = std::array<uint64_t, kNumStateWords>;
+
+// A State-sized mask stored without its zero words.  Bit `i` of `present` is
+// set iff word `i` of the mask is nonzero, and `words` holds the nonzero words
+// in order.
+struct CompactMask {
+  uint64_t present;
+  const uint64_t* words;
+};
+
+// What a State caches about its words.
+struct WordsSummary {
+  // See FingerprintWords().
+  absl::uint128 fingerprint;
+  uint32_t num_bits;
+  // kNumTargets and 0 when no bits are set.
+  uint16_t min_bit_index;
+  uint16_t max_bit_index;
+};
+
+// Returns a 128-bit hash of `words`.  It depends on nothing but the words, so
+// it is the same in every process and can be stored, unlike absl::Hash.
+absl::uint128 FingerprintWords(const StateWords& words);
+
+// Sets `*out` to the words with only the `num_bits` bits at `bits` set, which
+// must be distinct, and returns their summary.  This takes time in
+// proportion to the bits rather than to the words, so it is the same for
+// every instruction set.
+WordsSummary SetBits(const uint16_t* bits, int num_bits, StateWords* out);
+
+// The loops that build a State's words, each making a single pass that ANDs
+// the words, counts their bits, finds the lowest and highest set bit and
+// fingerprints them.  Every set gives the same results; they differ only in
+// the instructions they use.
+struct StateKernels {
+  const char* name;
+
+  // Sets `*out` to `initial` ANDed with each of the `num_masks` masks in
+  // `masks`, and returns its summary.
+  WordsSummary (*and_masks)(const StateWords& initial,
+                            const StateWords* const* masks, int num_masks,
+                            StateWords* out);
+
+  // As above, with the masks in compact form.  Only the words set in
+  // `initial_nonzero` and present in every mask are read; the rest of
+  // `initial` is taken to be zero.  `num_masks` must be at least one.
+  WordsSummary (*and_compact_masks)(const StateWords& initial,
+                                    uint64_t initial_nonzero,
+                                    const CompactMask* masks, int num_masks,
+                                    StateWords* out);
+};
+
+// The kernels State uses.  Before main() starts this is set to the best set
+// the CPU supports, "avx512" (which needs VPOPCNTQ), "avx2" or "generic",
+// unless $WORDLE_STATE_KERNELS names another supported set.  Until then it is
+// the generic set.
+extern const StateKernels* state_kernels;
+
+}  // namespace wordle
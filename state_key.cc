@@ -0,0 +1,185 @@
+#include "state_key.h"
+
+#include <cstring>
+
+#include "absl/numeric/bits.h"
+
+namespace wordle {
+
+namespace {
+
+// The first byte of the encoding after the length; see StateKey.
+enum Encoding : uint8_t {
+  kSetGaps,
+  kClearGaps,
+  kNonzeroWords,
+};
+
+constexpr int kPresentBytes = (kNumStateWords + 7) / 8;
+
+// The longest encoding: the tag, the mask of nonzero words and every word.
+constexpr int kMaxEncoding = 1 + kPresentBytes + 8 * kNumStateWords;
+
+// Writes the varint for `value` to `out`, and returns the bytes written.
+int PutVarint(unsigned value, uint8_t* out) {
+  int size = 0;
+  while (value > 0x7f) {
+    out[size++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  out[size++] = value;
+  return size;
+}
+
+// Reads the varint at `*in`, and advances past it.
+unsigned GetVarint(const uint8_t** in) {
+  unsigned value = 0;
+  for (int shift = 0;; shift += 7) {
+    const uint8_t byte = *(*in)++;
+    value |= unsigned(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) return value;
+  }
+}
+
+// Writes, for each set bit of `words` in order, its distance from the
+// previous one (or from bit -1) less one.  Returns the bytes written, or -1
+// if that would be more than `limit`.
+int EncodeGaps(const StateWords& words, int limit, uint8_t* out) {
+  uint8_t varint[8];
+  int size = 0;
+  int previous = -1;
+  for (int i = 0; i < kNumStateWords; ++i) {
+    uint64_t word = words[i];
+    while (word) {
+      const int bit = i * 64 + absl::countr_zero(word);
+      word &= word - 1;
+      const int n = PutVarint(bit - previous - 1, varint);
+      if (size + n > limit) return -1;
+      memcpy(out + size, varint, n);
+      size += n;
+      previous = bit;
+    }
+  }
+  return size;
+}
+
+void DecodeGaps(const uint8_t* in, const uint8_t* end, StateWords* words) {
+  int bit = -1;
+  while (in < end) {
+    bit += GetVarint(&in) + 1;
+    (*words)[bit / 64] |= uint64_t{1} << (bit % 64);
+  }
+}
+
+int EncodeNonzeroWords(const StateWords& words, uint8_t* out) {
+  uint64_t present = 0;
+  int size = kPresentBytes;
+  for (int i = 0; i < kNumStateWords; ++i) {
+    if (words[i]) {
+      present |= uint64_t{1} << i;
+      memcpy(out + size, &words[i], sizeof(uint64_t));
+      size += sizeof(uint64_t);
+    }
+  }
+  // The low bytes of the mask, as on x86.
+  memcpy(out, &present, kPresentBytes);
+  return size;
+}
+
+void DecodeNonzeroWords(const uint8_t* in, StateWords* words) {
+  uint64_t present = 0;
+  memcpy(&present, in, kPresentBytes);
+  in += kPresentBytes;
+  while (present) {
+    memcpy(&(*words)[absl::countr_zero(present)], in, sizeof(uint64_t));
+    in += sizeof(uint64_t);
+    present &= present - 1;
+  }
+}
+
+// Returns the targets missing from `words`.
+StateWords Complement(const StateWords& words) {
+  StateWords clear;
+  for (int i = 0; i < kNumStateWords; ++i) {
+    clear[i] = ~words[i];
+  }
+  if (kNumTargets % 64 != 0) {
+    clear.back() &= (uint64_t{1} << (kNumTargets % 64)) - 1;
+  }
+  return clear;
+}
+
+// Replaces the encoding in `out[0, *size)` with the gaps of `words`, tagged
+// `tag`, if they are shorter.  Every gap takes at least a byte.
+void MaybeEncodeGaps(const StateWords& words, int num_bits, Encoding tag,
+                     uint8_t* out, int* size) {
+  if (1 + num_bits >= *size) return;
+  uint8_t gaps[kMaxEncoding];
+  const int n = EncodeGaps(words, *size - 2, gaps);
+  if (n < 0) return;
+  out[0] = tag;
+  memcpy(out + 1, gaps, n);
+  *size = 1 + n;
+}
+
+}  // namespace
+
+StateKey::StateKey(const State& s) {
+  uint8_t encoding[kMaxEncoding];
+  encoding[0] = kNonzeroWords;
+  int size = 1 + EncodeNonzeroWords(s.array(), encoding + 1);
+  MaybeEncodeGaps(s.array(), s.count(), kSetGaps, encoding, &size);
+  if (2 * s.count() > kNumTargets) {
+    MaybeEncodeGaps(Complement(s.array()), kNumTargets - s.count(), kClearGaps,
+                    encoding, &size);
+  }
+
+  uint8_t length[8];
+  const int length_size = PutVarint(size, length);
+  bytes_ = std::make_unique<uint8_t[]>(length_size + size);
+  memcpy(bytes_.get(), length, length_size);
+  memcpy(bytes_.get() + length_size, encoding, size);
+}
+
+StateKey& StateKey::operator=(const StateKey& other) {
+  if (this == &other) return *this;
+  if (other.empty()) {
+    bytes_.reset();
+    return *this;
+  }
+  const size_t size = other.size();
+  bytes_ = std::make_unique<uint8_t[]>(size);
+  memcpy(bytes_.get(), other.bytes_.get(), size);
+  return *this;
+}
+
+size_t StateKey::size() const {
+  if (empty()) return 0;
+  const uint8_t* in = bytes_.get();
+  const unsigned length = GetVarint(&in);
+  return (in - bytes_.get()) + length;
+}
+
+bool StateKey::Matches(const State& s) const {
+  if (empty()) return false;
+  const uint8_t* in = bytes_.get();
+  const unsigned length = GetVarint(&in);
+  const uint8_t* end = in + length;
+  const Encoding tag = Encoding(*in++);
+  StateWords words = {};
+  switch (tag) {
+    case kSetGaps:
+      DecodeGaps(in, end, &words);
+      break;
+    case kClearGaps:
+      DecodeGaps(in, end, &words);
+      words = Complement(words);
+      break;
+    case kNonzeroWords:
+      DecodeNonzeroWords(in, &words);
+      break;
+  }
+  return words == s.array();
+}
+
+}  // namespace wordle
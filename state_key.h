@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "state.h"
+
+namespace wordle {
+
+// An exact, compact copy of a State's targets, for telling apart states whose
+// fingerprints or StateIds agree.  Caches keyed by a hash keep one beside each
+// result and check it with Matches() before trusting a hit.
+//
+// A key is one heap block holding the encoding's length followed by whichever
+// of these is shortest:
+//  - the gaps between successive set bits, as varints (a byte per target in
+//    most small states);
+//  - the same for the clear bits, for states holding most of the targets;
+//  - a mask of the state's nonzero words followed by those words.
+// So a key never takes more than a few bytes beyond the nonzero words of the
+// state, and usually far fewer than the 296 bytes of its bitset.
+class StateKey {
+ public:
+  // An empty key, which matches no state.
+  StateKey() = default;
+  explicit StateKey(const State& s);
+
+  StateKey(const StateKey& other) { *this = other; }
+  StateKey& operator=(const StateKey& other);
+  StateKey(StateKey&&) = default;
+  StateKey& operator=(StateKey&&) = default;
+
+  bool empty() const { return bytes_ == nullptr; }
+
+  // Returns true if this is the key of a state with the same targets as `s`.
+  // Allocates nothing.
+  bool Matches(const State& s) const;
+
+  // The bytes allocated for the key, or 0 if it is empty.
+  size_t size() const;
+
+ private:
+  std::unique_ptr<uint8_t[]> bytes_;
+};
+
+}  // namespace wordle
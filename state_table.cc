@@ -0,0 +1,75 @@
+#include "state_table.h"
+
+#include <algorithm>
+
+namespace wordle {
+
+namespace {
+
+constexpr size_t kMinSlots = 1024;
+
+// The low half of the fingerprint is in every StateId; probe by the other.
+// Its low bits pick the slot and its top bits are the tag.
+uint64_t SlotHash(const State& s) {
+  return absl::Uint128High64(s.Fingerprint());
+}
+
+uint16_t SlotTag(uint64_t hash) { return hash >> 48; }
+
+}  // namespace
+
+InternedState StateTable::Intern(const State& s) {
+  if (2 * (size_t(size_) + 1) > slots_.size()) {
+    Grow();
+  }
+  const uint64_t hash = SlotHash(s);
+  Slot& slot = Find(s, hash);
+  if (slot.generation != generation_) {
+    if (size_ / kBlockSize == int(blocks_.size())) {
+      blocks_.emplace_back().reserve(kBlockSize);
+    }
+    blocks_[size_ / kBlockSize].push_back(s);
+    slot = {generation_, SlotTag(hash), uint32_t(size_)};
+    ++size_;
+  }
+  return InternedState(&at(slot.index));
+}
+
+void StateTable::Prefetch(const State& s) const {
+  if (!slots_.empty()) {
+    __builtin_prefetch(&slots_[SlotHash(s) & (slots_.size() - 1)]);
+  }
+}
+
+void StateTable::Clear() {
+  for (std::vector<State>& block : blocks_) {
+    block.clear();
+  }
+  size_ = 0;
+  if (++generation_ == 0) {
+    std::fill(slots_.begin(), slots_.end(), Slot{});
+    generation_ = 1;
+  }
+}
+
+StateTable::Slot& StateTable::Find(const State& s, uint64_t hash) {
+  const size_t mask = slots_.size() - 1;
+  const uint16_t tag = SlotTag(hash);
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    Slot& slot = slots_[i];
+    if (slot.generation != generation_ ||
+        (slot.tag == tag && at(slot.index) == s)) {
+      return slot;
+    }
+  }
+}
+
+void StateTable::Grow() {
+  slots_.assign(std::max(kMinSlots, 2 * slots_.size()), Slot{});
+  for (int i = 0; i < size_; ++i) {
+    const uint64_t hash = SlotHash(at(i));
+    Find(at(i), hash) = {generation_, SlotTag(hash), uint32_t(i)};
+  }
+}
+
+}  // namespace wordle
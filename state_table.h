@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "state.h"
+
+namespace wordle {
+
+// A State held by a StateTable.  The table keeps one copy of each distinct
+// state, so two InternedStates from the same table are equal iff they point to
+// the same copy, and comparing them never reads the words.  It converts to the
+// State it points to, which stays valid until the table is next cleared.
+class InternedState {
+ public:
+  InternedState() = default;
+
+  const State& operator*() const { return *state_; }
+  const State* operator->() const { return state_; }
+  operator const State&() const { return *state_; }
+
+  int count() const { return state_->count(); }
+  StateId ToStateId() const { return state_->ToStateId(); }
+
+  bool operator==(InternedState r) const { return state_ == r.state_; }
+  bool operator!=(InternedState r) const { return state_ != r.state_; }
+
+ private:
+  friend class StateTable;
+  explicit InternedState(const State* state) : state_(state) {}
+
+  const State* state_ = nullptr;
+};
+
+// Interns States: Intern() returns the table's copy of a state, adding one
+// the first time the state is seen.  The root of the search has over a
+// million branches but well under half as many distinct ones, so a
+// PartitionList keeps its branches here.
+//
+// Clear() keeps the table's memory for the next use, and otherwise the table
+// only grows, so a table that has grown to fit interns without allocating.
+// Interning is not synchronized: fill a table from one thread, after which
+// any number of threads may read its states until it is next changed.
+class StateTable {
+ public:
+  StateTable() = default;
+  StateTable(const StateTable&) = delete;
+  StateTable& operator=(const StateTable&) = delete;
+
+  // Returns the table's copy of `s`.
+  InternedState Intern(const State& s);
+
+  // Starts loading the part of the table Intern(s) will read first.
+  void Prefetch(const State& s) const;
+
+  // Removes every state, invalidating the InternedStates handed out.
+  void Clear();
+
+  // The number of distinct states interned since the last Clear().
+  int size() const { return size_; }
+
+ private:
+  // States are stored in blocks of this many, which never move once
+  // allocated.
+  static constexpr int kBlockSize = 4096;
+
+  // An entry of the hash table, holding the index of a state if its
+  // generation is the table's.  Clear() empties every entry at once by
+  // starting a new generation.  `tag` holds more bits of the state's hash,
+  // so probing rarely reads a state that does not match.
+  struct Slot {
+    uint16_t generation = 0;
+    uint16_t tag = 0;
+    uint32_t index = 0;
+  };
+
+  const State& at(uint32_t index) const {
+    return blocks_[index / kBlockSize][index % kBlockSize];
+  }
+
+  // Returns the slot holding `s`, or the empty slot where it belongs.
+  // `hash` is SlotHash(s).
+  Slot& Find(const State& s, uint64_t hash);
+
+  // Doubles the hash table and reinserts the states.
+  void Grow();
+
+  std::vector<std::vector<State>> blocks_;
+  int size_ = 0;
+  std::vector<Slot> slots_;
+  uint16_t generation_ = 1;
+};
+
+}  // namespace wordle